@@ -0,0 +1,133 @@
+/*
+  This file is part of the PhantomJS project from Ofi Labs.
+
+  Copyright (C) 2011 Ariya Hidayat <ariya.hidayat@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Benchmark for the cookie jar behind phantom.cookies.
+//
+// Usage: cookiebench [--cookies N] [--lookups N]
+//
+// The same cookies are fed to QNetworkCookieJar and to the domain-indexed
+// NetworkCookieJar, and each stage is printed as one JSON object.
+
+#include <QtCore>
+#include <QtNetwork>
+
+#include <stdio.h>
+
+#include "cookiejar.h"
+
+// Only exposes the protected list so the plain jar can be listed as well.
+class PlainCookieJar: public QNetworkCookieJar
+{
+public:
+    int count() const { return allCookies().count(); }
+};
+
+static void report(const char *jar, const char *stage, int cookies, int operations, int elapsed)
+{
+    const double ms = elapsed;
+    const double opsPerSecond = ms > 0 ? operations * 1000.0 / ms : 0;
+    printf("{\"jar\": \"%s\", \"stage\": \"%s\", \"cookies\": %d, \"operations\": %d, "
+           "\"ms\": %d, \"operationsPerSecond\": %.0f}\n",
+           jar, stage, cookies, operations, elapsed, opsPerSecond);
+    fflush(stdout);
+}
+
+static QUrl siteUrl(int site)
+{
+    return QUrl(QString("http://www.site%1.example.com/app/page.html").arg(site));
+}
+
+static QList<QNetworkCookie> siteCookies(int site, int index)
+{
+    QNetworkCookie cookie(QString("cookie%1").arg(index).toLatin1(), QByteArray(32, 'x'));
+    // Mix host-only cookies, domain cookies and a longer path.
+    if (index % 3 == 1)
+        cookie.setDomain(QString(".site%1.example.com").arg(site));
+    if (index % 3 == 2)
+        cookie.setPath("/app/");
+    cookie.setExpirationDate(QDateTime::currentDateTime().addDays(1));
+    return QList<QNetworkCookie>() << cookie;
+}
+
+template <typename Jar>
+static void run(const char *name, Jar &jar, int cookies, int lookups)
+{
+    const int sites = qMax(1, cookies / 5);
+
+    QTime timer;
+    timer.start();
+    for (int i = 0; i < cookies; ++i)
+        jar.setCookiesFromUrl(siteCookies(i % sites, i), siteUrl(i % sites));
+    report(name, "insert", cookies, cookies, timer.elapsed());
+
+    int matches = 0;
+    timer.start();
+    for (int i = 0; i < lookups; ++i)
+        matches += jar.cookiesForUrl(siteUrl((i * 7919) % sites)).count();
+    report(name, "lookup", cookies, lookups, timer.elapsed());
+
+    timer.start();
+    const int total = jar.count();
+    report(name, "count", cookies, 1, timer.elapsed());
+
+    if (matches == 0 || total == 0)
+        fprintf(stderr, "%s: no cookies matched, the benchmark is broken\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    int cookies = 10000;
+    int lookups = 10000;
+    QStringList args = app.arguments();
+    for (int i = 1; i + 1 < args.count(); ++i) {
+        if (args.at(i) == "--cookies")
+            cookies = qMax(1, args.at(++i).toInt());
+        else if (args.at(i) == "--lookups")
+            lookups = qMax(1, args.at(++i).toInt());
+    }
+
+    PlainCookieJar plain;
+    run("QNetworkCookieJar", plain, cookies, lookups);
+
+    NetworkCookieJar indexed;
+    run("NetworkCookieJar", indexed, cookies, lookups);
+
+    QTime timer;
+    timer.start();
+    const int listed = indexed.cookies().count();
+    report("NetworkCookieJar", "list", cookies, listed, timer.elapsed());
+
+    timer.start();
+    indexed.purgeExpired();
+    report("NetworkCookieJar", "purge", cookies, indexed.count(), timer.elapsed());
+
+    return 0;
+}
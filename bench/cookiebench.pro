@@ -0,0 +1,10 @@
+TEMPLATE = app
+TARGET = cookiebench
+DESTDIR = ../bin
+INCLUDEPATH += ../src
+HEADERS = ../src/cookiejar.h
+SOURCES = cookiebench.cpp ../src/cookiejar.cpp
+QT += network
+QT -= gui
+CONFIG += console
+CONFIG -= app_bundle
@@ -0,0 +1,338 @@
+/*
+  This file is part of the PhantomJS project from Ofi Labs.
+
+  Copyright (C) 2011 Ariya Hidayat <ariya.hidayat@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Microbenchmark for the image pipeline used by phantom.render().
+//
+// Usage: imagebench [--iterations N] [image ...]
+//
+// Every stage is run on a set of synthetic pages plus any image given on the
+// command line. One JSON object is printed per (image, stage) pair so that
+// the output can be collected and compared between builds.
+
+#include <QtGui>
+
+#include <stdio.h>
+
+#ifdef Q_OS_LINUX
+#include <string.h>
+#endif
+
+#include "gif_lib.h"
+#include "gifwriter.h"
+
+// Peak resident set size of the process in KiB. On Linux the high-water
+// mark is reset before every stage so each stage reports its own peak.
+static void resetPeakMemory()
+{
+#ifdef Q_OS_LINUX
+    QFile file("/proc/self/clear_refs");
+    if (file.open(QFile::WriteOnly))
+        file.write("5");
+#endif
+}
+
+static long peakMemory()
+{
+#ifdef Q_OS_LINUX
+    FILE *status = fopen("/proc/self/status", "r");
+    if (!status)
+        return -1;
+    char line[256];
+    long result = -1;
+    while (fgets(line, sizeof(line), status)) {
+        if (strncmp(line, "VmHWM:", 6) == 0) {
+            result = atol(line + 6);
+            break;
+        }
+    }
+    fclose(status);
+    return result;
+#else
+    return -1;
+#endif
+}
+
+static QImage syntheticGradient(int width, int height)
+{
+    QImage image(width, height, QImage::Format_ARGB32);
+    for (int y = 0; y < height; ++y) {
+        QRgb *line = (QRgb*)(image.scanLine(y));
+        for (int x = 0; x < width; ++x)
+            line[x] = qRgb(x * 255 / width, y * 255 / height, (x + y) & 0xff);
+    }
+    return image;
+}
+
+static QImage syntheticNoise(int width, int height)
+{
+    QImage image(width, height, QImage::Format_ARGB32);
+    unsigned int seed = 42;
+    for (int y = 0; y < height; ++y) {
+        QRgb *line = (QRgb*)(image.scanLine(y));
+        for (int x = 0; x < width; ++x) {
+            seed = seed * 1103515245 + 12345;
+            line[x] = qRgb(seed >> 24, (seed >> 16) & 0xff, (seed >> 8) & 0xff);
+        }
+    }
+    return image;
+}
+
+// Resembles a rendered document: a header bar, a few colored boxes and a lot
+// of antialiased text on a white background.
+static QImage syntheticPage(int width, int height)
+{
+    QImage image(width, height, QImage::Format_ARGB32);
+    image.fill(qRgba(255, 255, 255, 255));
+    QPainter p(&image);
+    p.setRenderHint(QPainter::Antialiasing, true);
+    p.setRenderHint(QPainter::TextAntialiasing, true);
+    p.fillRect(0, 0, width, 60, QColor(34, 68, 136));
+    p.fillRect(width - 220, 80, 200, height - 100, QColor(240, 240, 232));
+    p.setPen(Qt::black);
+    const QString text("The quick brown fox jumps over the lazy dog. 0123456789");
+    for (int y = 90; y < height - 20; y += 18) {
+        if ((y / 18) % 12 == 0)
+            p.fillRect(20, y, width - 260, 120, QColor(200, 120 + y % 100, 60));
+        p.drawText(20, y, text);
+    }
+    p.end();
+    return image;
+}
+
+struct BenchImage {
+    QString name;
+    QImage image;
+};
+
+static void report(const BenchImage &input, const char *stage, int iterations,
+                   int elapsed, long peak, qint64 outputBytes = -1)
+{
+    const double ms = double(elapsed) / iterations;
+    const double pixels = double(input.image.width()) * input.image.height();
+    const double mpps = ms > 0 ? pixels / (ms * 1000.0) : 0;
+    printf("{\"image\": \"%s\", \"width\": %d, \"height\": %d, \"stage\": \"%s\", "
+           "\"iterations\": %d, \"msPerIteration\": %.3f, \"megapixelsPerSecond\": %.2f, "
+           "\"peakRssKb\": %ld",
+           qPrintable(input.name), input.image.width(), input.image.height(), stage,
+           iterations, ms, mpps, peak);
+    if (outputBytes >= 0)
+        printf(", \"outputBytes\": %lld", (long long)outputBytes);
+    printf("}\n");
+    fflush(stdout);
+}
+
+static int discardGifBlock(GifFileType *gif, const GifByteType *data, int i)
+{
+    Q_UNUSED(data);
+    *(qint64*)(gif->UserData) += i;
+    return i;
+}
+
+// LZW only: the image is indexed up front so that nothing but the encoder
+// itself is measured.
+static qint64 compressIndexed(const QImage &indexed)
+{
+    ColorMapObject cmap;
+    cmap.ColorCount = 256;
+    cmap.BitsPerPixel = 8;
+    cmap.Colors = new GifColorType[256];
+    QVector<QRgb> colorTable = indexed.colorTable();
+    for (int c = 0; c < 256; ++c) {
+        QRgb color = c < colorTable.count() ? colorTable[c] : 0;
+        cmap.Colors[c].Red = qRed(color);
+        cmap.Colors[c].Green = qGreen(color);
+        cmap.Colors[c].Blue = qBlue(color);
+    }
+
+    qint64 bytes = 0;
+    GifFileType *gif = EGifOpen(&bytes, discardGifBlock);
+    EGifPutScreenDesc(gif, indexed.width(), indexed.height(), 256, 0, &cmap);
+    EGifPutImageDesc(gif, 0, 0, indexed.width(), indexed.height(), 0, &cmap);
+    for (int y = 0; y < indexed.height(); ++y)
+        EGifPutLine(gif, (GifPixelType*)(indexed.scanLine(y)), indexed.width());
+    EGifCloseFile(gif);
+
+    delete [] cmap.Colors;
+    return bytes;
+}
+
+static void runStages(const BenchImage &input, int iterations)
+{
+    const QImage &image = input.image;
+    const int width = image.width();
+    const int height = image.height();
+    const int dim = width * height;
+
+    GifByteType *rBuffer = new GifByteType[dim];
+    GifByteType *gBuffer = new GifByteType[dim];
+    GifByteType *bBuffer = new GifByteType[dim];
+    GifByteType *outputBuffer = new GifByteType[dim];
+    GifColorType colors[256];
+
+    QTime timer;
+
+    // ARGB split into the planar buffers QuantizeBuffer expects.
+    resetPeakMemory();
+    timer.start();
+    for (int n = 0; n < iterations; ++n) {
+        for (int y = 0; y < height; ++y) {
+            const QRgb *line = (const QRgb*)(image.scanLine(y));
+            for (int x = 0; x < width; ++x) {
+                rBuffer[x + y * width] = qRed(line[x]);
+                gBuffer[x + y * width] = qGreen(line[x]);
+                bBuffer[x + y * width] = qBlue(line[x]);
+            }
+        }
+    }
+    report(input, "split", iterations, timer.elapsed(), peakMemory());
+
+    // Histogram, median cut and index mapping happen in one call.
+    int colorCount = 255;
+    resetPeakMemory();
+    timer.start();
+    for (int n = 0; n < iterations; ++n) {
+        colorCount = 255;
+        QuantizeBuffer(width, height, &colorCount, rBuffer, gBuffer, bBuffer, outputBuffer, colors);
+    }
+    report(input, "quantize", iterations, timer.elapsed(), peakMemory());
+
+    delete [] outputBuffer;
+    delete [] rBuffer;
+    delete [] gBuffer;
+    delete [] bBuffer;
+
+    QVector<QRgb> colorTable;
+    for (int c = 0; c < colorCount; ++c)
+        colorTable += qRgb(colors[c].Red, colors[c].Green, colors[c].Blue);
+
+    resetPeakMemory();
+    timer.start();
+    GifPalette palette;
+    for (int n = 0; n < iterations; ++n)
+        palette = GifPalette::fromColors(colorTable);
+    report(input, "palette-lookup", iterations, timer.elapsed(), peakMemory());
+
+    QImage indexed;
+    resetPeakMemory();
+    timer.start();
+    for (int n = 0; n < iterations; ++n)
+        indexed = palette.map(image);
+    report(input, "map", iterations, timer.elapsed(), peakMemory());
+
+    qint64 bytes = 0;
+    resetPeakMemory();
+    timer.start();
+    for (int n = 0; n < iterations; ++n)
+        bytes = compressIndexed(indexed);
+    report(input, "lzw", iterations, timer.elapsed(), peakMemory(), bytes);
+
+    resetPeakMemory();
+    timer.start();
+    for (int n = 0; n < iterations; ++n)
+        bytes = encodeGif(image).size();
+    report(input, "gif", iterations, timer.elapsed(), peakMemory(), bytes);
+
+    // Painting the image and some text over it into each buffer format
+    // render() can choose from, as WebKit would paint a page.
+    const QImage::Format paintFormats[] = {
+        QImage::Format_ARGB32, QImage::Format_ARGB32_Premultiplied, QImage::Format_RGB32
+    };
+    const char *paintStages[] = { "paint-argb32", "paint-premultiplied", "paint-rgb32" };
+    const QString text("The quick brown fox jumps over the lazy dog. 0123456789");
+    for (uint f = 0; f < sizeof(paintFormats) / sizeof(paintFormats[0]); ++f) {
+        resetPeakMemory();
+        timer.start();
+        for (int n = 0; n < iterations; ++n) {
+            QImage buffer(width, height, paintFormats[f]);
+            buffer.fill(paintFormats[f] == QImage::Format_RGB32 ? qRgb(255, 255, 255) : 0);
+            QPainter p(&buffer);
+            p.setRenderHint(QPainter::Antialiasing, true);
+            p.setRenderHint(QPainter::TextAntialiasing, true);
+            p.drawImage(0, 0, image);
+            p.setPen(Qt::black);
+            for (int y = 20; y < height; y += 18)
+                p.drawText(20, y, text);
+        }
+        report(input, paintStages[f], iterations, timer.elapsed(), peakMemory());
+    }
+
+    const char *formats[] = { "PNG", "JPEG" };
+    const char *stages[] = { "png", "jpeg" };
+    for (uint f = 0; f < sizeof(formats) / sizeof(formats[0]); ++f) {
+        resetPeakMemory();
+        timer.start();
+        for (int n = 0; n < iterations; ++n) {
+            QByteArray data;
+            QBuffer buffer(&data);
+            buffer.open(QIODevice::WriteOnly);
+            image.save(&buffer, formats[f]);
+            bytes = data.size();
+        }
+        report(input, stages[f], iterations, timer.elapsed(), peakMemory(), bytes);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    QApplication app(argc, argv, false);
+
+    int iterations = 5;
+    QList<BenchImage> inputs;
+
+    QStringList args = app.arguments();
+    args.removeFirst();
+    QStringListIterator argIterator(args);
+    while (argIterator.hasNext()) {
+        const QString &arg = argIterator.next();
+        if (arg == "--iterations" && argIterator.hasNext()) {
+            iterations = qMax(1, argIterator.next().toInt());
+            continue;
+        }
+        BenchImage input;
+        input.name = QFileInfo(arg).fileName();
+        input.image = QImage(arg).convertToFormat(QImage::Format_ARGB32);
+        if (input.image.isNull()) {
+            fprintf(stderr, "Unable to load %s\n", qPrintable(arg));
+            return 1;
+        }
+        inputs += input;
+    }
+
+    BenchImage gradient = { "synthetic-gradient", syntheticGradient(1024, 768) };
+    BenchImage noise = { "synthetic-noise", syntheticNoise(1024, 768) };
+    BenchImage page = { "synthetic-page", syntheticPage(1024, 4096) };
+    inputs.prepend(page);
+    inputs.prepend(noise);
+    inputs.prepend(gradient);
+
+    foreach (const BenchImage &input, inputs)
+        runStages(input, iterations);
+
+    return 0;
+}
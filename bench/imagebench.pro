@@ -0,0 +1,8 @@
+TEMPLATE = app
+TARGET = imagebench
+DESTDIR = ../bin
+SOURCES = imagebench.cpp
+CONFIG += console
+CONFIG -= app_bundle
+
+include(../src/gif/gif.pri)
@@ -0,0 +1,236 @@
+#!/usr/bin/env python3
+'''
+  This file is part of the PhantomJS project from Ofi Labs.
+
+  End-to-end throughput benchmark: serves a fixed corpus of pages from a
+  local HTTP server and drives phantomjs through open, load and render,
+  so that no run depends on the internet.
+
+  Usage:
+    pagebench.py [--phantomjs PATH] [--phantomjs-args ARGS] [--runs N]
+                 [--concurrency 1,4] [--output results.json]
+                 [--baseline baseline.json]
+
+  For example, the cost of each storage mode on a storage-heavy page:
+    pagebench.py --pages storage.html --phantomjs-args=--storage=disk
+    pagebench.py --pages storage.html --phantomjs-args=--storage=memory
+    pagebench.py --pages storage.html --phantomjs-args=--storage=off
+
+  Cold start is measured first by running a script that exits right away
+  (--startup-runs, 0 to skip). Then every (page, script, concurrency)
+  combination reports p50/p95 latency,
+  pages per second, CPU time and peak RSS per phantomjs process. With
+  --baseline the results are compared against a previous --output file and
+  the exit code is non-zero when something regressed beyond --tolerance.
+'''
+
+import argparse, json, os, shutil, struct, subprocess, sys, tempfile, threading, time, zlib
+from concurrent.futures import ThreadPoolExecutor
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+ROOT_DIR = os.path.dirname(BENCH_DIR)
+PAGES_DIR = os.path.join(BENCH_DIR, 'pages')
+
+PAGES = ['static.html', 'scripted.html', 'images.html', 'tall.html', 'storage.html']
+SCRIPTS = {
+    'loadspeed': (os.path.join(ROOT_DIR, 'examples', 'loadspeed.js'), False),
+    'rasterize': (os.path.join(ROOT_DIR, 'examples', 'rasterize.js'), True),
+    'startup': (os.path.join(ROOT_DIR, 'examples', 'version.js'), False),
+}
+
+
+def png(width, height, seed):
+    rows = b''
+    for y in range(height):
+        row = bytearray([0])
+        for x in range(width):
+            row += bytes(((x * 7 + seed * 31) & 0xff, (y * 5 + seed * 17) & 0xff, ((x ^ y) + seed) & 0xff))
+        rows += bytes(row)
+
+    def chunk(kind, data):
+        body = kind + data
+        return struct.pack('>I', len(data)) + body + struct.pack('>I', zlib.crc32(body) & 0xffffffff)
+
+    return (b'\x89PNG\r\n\x1a\n' +
+            chunk(b'IHDR', struct.pack('>IIBBBBB', width, height, 8, 2, 0, 0, 0)) +
+            chunk(b'IDAT', zlib.compress(rows)) +
+            chunk(b'IEND', b''))
+
+
+def images_page():
+    imgs = ''.join('<img src="/image/%d.png" width="160" height="120">\n' % i for i in range(60))
+    return '<!DOCTYPE html><html><head><title>Images</title></head><body>\n%s</body></html>' % imgs
+
+
+def tall_page():
+    paragraph = ('<p>Paragraph %d. Lorem ipsum dolor sit amet, consectetur adipiscing elit. '
+                 'Integer nec odio. Praesent libero. Sed cursus ante dapibus diam.</p>\n')
+    body = ''.join(paragraph % i for i in range(3000))
+    return '<!DOCTYPE html><html><head><title>Tall</title></head><body>\n%s</body></html>' % body
+
+
+class FixtureHandler(BaseHTTPRequestHandler):
+    generated = {
+        '/images.html': images_page().encode('utf-8'),
+        '/tall.html': tall_page().encode('utf-8'),
+    }
+    image_cache = {}
+    lock = threading.Lock()
+
+    def do_GET(self):
+        path = self.path.split('?')[0]
+        if path in self.generated:
+            self.reply(self.generated[path], 'text/html')
+        elif path.startswith('/image/') and path.endswith('.png'):
+            seed = int(path[7:-4]) if path[7:-4].isdigit() else 0
+            with self.lock:
+                if seed not in self.image_cache:
+                    self.image_cache[seed] = png(160, 120, seed)
+                data = self.image_cache[seed]
+            self.reply(data, 'image/png')
+        else:
+            name = os.path.basename(path)
+            file_name = os.path.join(PAGES_DIR, name)
+            if name and os.path.isfile(file_name):
+                with open(file_name, 'rb') as f:
+                    self.reply(f.read(), 'text/html')
+            else:
+                self.send_error(404)
+
+    def reply(self, data, content_type):
+        self.send_response(200)
+        self.send_header('Content-Type', content_type)
+        self.send_header('Content-Length', str(len(data)))
+        self.end_headers()
+        self.wfile.write(data)
+
+    def log_message(self, format, *args):
+        pass
+
+
+def run_once(phantomjs, script, url, render_dir):
+    script_file, renders = SCRIPTS[script]
+    args = phantomjs + [script_file, url]
+    if renders:
+        handle, output = tempfile.mkstemp(suffix='.png', dir=render_dir)
+        os.close(handle)
+        args.append(output)
+    start = time.time()
+    process = subprocess.Popen(args, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    _, status, usage = os.wait4(process.pid, 0)
+    elapsed = time.time() - start
+    # The scripts exit non-zero when the page did not load; a render must
+    # also have produced an image.
+    ok = status == 0
+    if renders:
+        ok = ok and os.path.getsize(output) > 0
+        os.remove(output)
+    return {
+        'ok': ok,
+        'latency': elapsed * 1000.0,
+        'cpu': (usage.ru_utime + usage.ru_stime) * 1000.0,
+        'rss': usage.ru_maxrss,
+    }
+
+
+def percentile(values, fraction):
+    values = sorted(values)
+    index = min(len(values) - 1, int(round(fraction * (len(values) - 1))))
+    return values[index]
+
+
+def measure(phantomjs, script, url, runs, concurrency, render_dir):
+    start = time.time()
+    with ThreadPoolExecutor(max_workers=concurrency) as pool:
+        samples = list(pool.map(lambda _: run_once(phantomjs, script, url, render_dir), range(runs)))
+    wall = time.time() - start
+    latencies = [s['latency'] for s in samples]
+    return {
+        'runs': runs,
+        'failures': sum(1 for s in samples if not s['ok']),
+        'p50Ms': percentile(latencies, 0.50),
+        'p95Ms': percentile(latencies, 0.95),
+        'pagesPerSecond': runs / wall if wall > 0 else 0,
+        'cpuMsMean': sum(s['cpu'] for s in samples) / runs,
+        'rssKbMax': max(s['rss'] for s in samples),
+    }
+
+
+# For these metrics a larger value is a regression; pagesPerSecond is the
+# other way round.
+LOWER_IS_BETTER = ['p50Ms', 'p95Ms', 'cpuMsMean', 'rssKbMax']
+
+
+def compare(results, baseline, tolerance):
+    regressions = 0
+    for key in sorted(results):
+        if key not in baseline:
+            continue
+        current, previous = results[key], baseline[key]
+        for metric in LOWER_IS_BETTER + ['pagesPerSecond']:
+            if not previous.get(metric):
+                continue
+            ratio = current[metric] / previous[metric]
+            worse = ratio > 1 + tolerance if metric in LOWER_IS_BETTER else ratio < 1 - tolerance
+            if worse:
+                regressions += 1
+                print('REGRESSION %s %s: %.2f -> %.2f (%+.1f%%)' %
+                      (key, metric, previous[metric], current[metric], (ratio - 1) * 100))
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description='End-to-end phantomjs throughput benchmark')
+    parser.add_argument('--phantomjs', default=os.path.join(ROOT_DIR, 'bin', 'phantomjs'))
+    parser.add_argument('--phantomjs-args', default='', help='extra options passed to phantomjs')
+    parser.add_argument('--runs', type=int, default=20, help='runs per combination (default: %(default)s)')
+    parser.add_argument('--concurrency', default='1,4', help='comma separated worker counts (default: %(default)s)')
+    parser.add_argument('--pages', default=','.join(PAGES))
+    parser.add_argument('--scripts', default='loadspeed,rasterize')
+    parser.add_argument('--startup-runs', type=int, default=20, help='cold start runs (default: %(default)s)')
+    parser.add_argument('--output', help='write the results as JSON to this file')
+    parser.add_argument('--baseline', help='compare against a previous --output file')
+    parser.add_argument('--tolerance', type=float, default=0.10, help='allowed relative change (default: %(default)s)')
+    args = parser.parse_args()
+
+    server = ThreadingHTTPServer(('127.0.0.1', 0), FixtureHandler)
+    thread = threading.Thread(target=server.serve_forever)
+    thread.daemon = True
+    thread.start()
+    base_url = 'http://127.0.0.1:%d/' % server.server_address[1]
+    phantomjs = [args.phantomjs] + args.phantomjs_args.split()
+
+    render_dir = tempfile.mkdtemp(prefix='pagebench-')
+    results = {}
+    try:
+        if args.startup_runs > 0:
+            results['startup'] = measure(phantomjs, 'startup', base_url, args.startup_runs, 1, render_dir)
+            print(json.dumps(dict(results['startup'], key='startup'), sort_keys=True))
+            sys.stdout.flush()
+        for page in args.pages.split(','):
+            for script in args.scripts.split(','):
+                for concurrency in [int(c) for c in args.concurrency.split(',')]:
+                    key = '%s/%s/c%d' % (page, script, concurrency)
+                    results[key] = measure(phantomjs, script, base_url + page,
+                                           args.runs, concurrency, render_dir)
+                    print(json.dumps(dict(results[key], key=key), sort_keys=True))
+                    sys.stdout.flush()
+    finally:
+        server.shutdown()
+        shutil.rmtree(render_dir, ignore_errors=True)
+
+    if args.output:
+        with open(args.output, 'w') as f:
+            json.dump(results, f, indent=2, sort_keys=True)
+
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+        if compare(results, baseline, args.tolerance):
+            return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
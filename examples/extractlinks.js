@@ -0,0 +1,23 @@
+// Extract the text and target of every link on a page in one native pass
+
+if (phantom.state.length === 0) {
+    if (phantom.args.length < 1 || phantom.args.length > 2) {
+        console.log('Usage: extractlinks.js URL [output.json]');
+        phantom.exit();
+    } else {
+        phantom.state = 'extract';
+        phantom.open(phantom.args[0]);
+    }
+} else {
+    if (phantom.args.length === 2) {
+        // One JSON line per link, written straight from native code.
+        phantom.openStream(phantom.args[1]);
+        var count = phantom.extract('a[href]', { attrs: ['href'], output: phantom.args[1] });
+        console.log('Wrote ' + count + ' links to ' + phantom.args[1]);
+    } else {
+        phantom.extract('a[href]', { attrs: ['href'] }).forEach(function (row) {
+            console.log(row[0] + ' -> ' + row[1]);
+        });
+    }
+    phantom.exit();
+}
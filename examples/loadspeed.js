@@ -13,8 +13,9 @@ if (phantom.state.length === 0) {
     if (phantom.loadStatus === 'success') {
         console.log('Page title is ' + document.title);
         console.log('Loading time ' + elapsed + ' msec');
+        phantom.exit();
     } else {
         console.log('FAIL to load the address');
+        phantom.exit(1);
     }
-    phantom.exit();
 }
@@ -0,0 +1,24 @@
+// Tell whether a page changed since the last run, without rendering it
+
+if (phantom.state.length === 0) {
+    if (phantom.args.length < 1 || phantom.args.length > 2) {
+        console.log('Usage: pagechanged.js URL [fingerprint]');
+        phantom.exit();
+    } else {
+        phantom.state = 'fingerprint';
+        phantom.open(phantom.args[0]);
+    }
+} else {
+    // Ads and clocks change on every load, so they are left out.
+    var fingerprint = phantom.fingerprint({
+        selector: 'body',
+        attrs: ['href', 'src'],
+        ignore: ['script', 'iframe', '.ad', 'time']
+    });
+    if (phantom.args.length === 2 && phantom.args[1] === fingerprint) {
+        console.log('unchanged');
+    } else {
+        console.log(fingerprint);
+    }
+    phantom.exit();
+}
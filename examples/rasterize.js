@@ -14,9 +14,11 @@ if (phantom.state.length === 0) {
         }
         phantom.open(address);
     }
+} else if (phantom.loadStatus !== 'success') {
+    console.log('Unable to load the address!');
+    phantom.exit(1);
 } else {
     var output = phantom.args[1];
     phantom.sleep(200);
-    phantom.render(output);
-    phantom.exit();
+    phantom.exit(phantom.render(output) ? 0 : 1);
 }
@@ -1,3 +1,4 @@
 TEMPLATE = subdirs
 CONFIG += ordered
 SUBDIRS += src/phantomjs.pro
+SUBDIRS += bench/bench.pro
@@ -19,25 +19,36 @@
 '''
 
 import sys, resources
-from PyQt4.QtCore import QObject, QFile, QVariant, QString
-from PyQt4.QtWebKit import QWebPage, QWebFrame
+from PyQt4.QtCore import QObject, QFile, QString
+from PyQt4.QtScript import QScriptEngine, QScriptValue
 
 class CSConverter(QObject):
+    _instance = None
+
+    # the compiler is loaded once and shared by every caller
+    @classmethod
+    def instance(cls):
+        if cls._instance is None:
+            cls._instance = cls()
+        return cls._instance
+
     def __init__(self, parent = None):
         QObject.__init__(self, parent)
-        self.m_webPage = QWebPage(self)
+        self.m_engine = QScriptEngine(self)
 
         converter = QFile(':/resources/coffee-script.js')
         converter.open(QFile.ReadOnly)
 
         script = QString.fromUtf8(converter.readAll())
         converter.close()
-        self.m_webPage.mainFrame().evaluateJavaScript(script)
-        self.m_webPage.mainFrame().addToJavaScriptWindowObject('converter', self)
+        self.m_engine.evaluate(script, 'coffee-script.js')
+        self.m_compile = self.m_engine.globalObject().property('CoffeeScript').property('compile')
 
     def convert(self, script):
-        self.setProperty('source', script)
-        result = self.m_webPage.mainFrame().evaluateJavaScript('this.CoffeeScript.compile(converter.source)')
-        if result.type() == QVariant.String:
+        result = self.m_compile.call(QScriptValue(), [QScriptValue(self.m_engine, script)])
+        if self.m_engine.hasUncaughtException():
+            self.m_engine.clearExceptions()
+            return QString()
+        if result.isString():
             return result.toString()
         return QString()
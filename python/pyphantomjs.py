@@ -178,8 +178,7 @@ class Phantom(QObject):
             self.m_script.prepend('//')
 
         if self.m_scriptFile.endswith('.coffee'):
-            coffee = CSConverter(self)
-            self.m_script = coffee.convert(self.m_script)
+            self.m_script = CSConverter.instance().convert(self.m_script)
 
         self.m_page.mainFrame().evaluateJavaScript(self.m_script)
 
@@ -297,8 +296,7 @@ class Phantom(QObject):
             script.prepend('//')
 
         if scriptFile.endsWith('.coffee'):
-            coffee = CSConverter(self)
-            script = QString.fromUtf8(coffee.convert(script))
+            script = QString.fromUtf8(CSConverter.instance().convert(script))
 
         self.m_loadScript_cache[scriptFile] = script
         self.m_page.mainFrame().evaluateJavaScript(script)
@@ -0,0 +1,192 @@
+/*
+  This file is part of the PhantomJS project from Ofi Labs.
+
+  Copyright (C) 2011 Ariya Hidayat <ariya.hidayat@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "consolewriter.h"
+#include "jsonwriter.h"
+
+#include <QDateTime>
+#include <QMutexLocker>
+
+#include <stdio.h>
+
+ConsoleWriter::ConsoleWriter(QObject *parent)
+    : QThread(parent)
+    , m_dropped(0)
+    , m_stopping(false)
+    , m_flushInterval(100)
+    , m_maxQueueSize(10000)
+    , m_format(PlainText)
+{
+}
+
+ConsoleWriter::~ConsoleWriter()
+{
+    stop();
+}
+
+void ConsoleWriter::setFlushInterval(int ms)
+{
+    QMutexLocker locker(&m_mutex);
+    m_flushInterval = qMax(0, ms);
+}
+
+void ConsoleWriter::setMaxQueueSize(int size)
+{
+    QMutexLocker locker(&m_mutex);
+    m_maxQueueSize = qMax(1, size);
+}
+
+void ConsoleWriter::setFormat(Format format)
+{
+    QMutexLocker locker(&m_mutex);
+    m_format = format;
+}
+
+void ConsoleWriter::write(const QString &type, const QString &message,
+                          const QString &source, int line)
+{
+    const QDateTime now = QDateTime::currentDateTime().toUTC();
+
+    Entry entry;
+    entry.timestamp = qint64(now.toTime_t()) * 1000 + now.time().msec();
+    entry.type = type;
+    entry.message = message;
+    entry.source = source;
+    entry.line = line;
+
+    QMutexLocker locker(&m_mutex);
+    if (m_stopping)
+        return;
+    if (m_queue.count() >= m_maxQueueSize) {
+        ++m_dropped;
+        return;
+    }
+    m_queue.enqueue(entry);
+
+    if (!isRunning()) {
+        locker.unlock();
+        start();
+        return;
+    }
+
+    // Wake the writer for the first message of a batch, and do not wait for
+    // the rest of the interval when the queue is filling up.
+    if (m_queue.count() == 1 || m_flushInterval == 0 || m_queue.count() >= m_maxQueueSize / 2)
+        m_condition.wakeOne();
+}
+
+quint64 ConsoleWriter::droppedCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_dropped;
+}
+
+void ConsoleWriter::stop()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopping = true;
+        m_condition.wakeOne();
+    }
+    wait();
+
+    // The thread is gone; write whatever was queued after it finished.
+    QByteArray data;
+    while (!m_queue.isEmpty())
+        data += format(m_queue.dequeue());
+    if (!data.isEmpty()) {
+        fwrite(data.constData(), 1, data.size(), stdout);
+        fflush(stdout);
+    }
+
+    if (m_dropped > 0) {
+        fprintf(stderr, "%llu console messages were dropped\n", (unsigned long long)m_dropped);
+        m_dropped = 0;
+    }
+}
+
+void ConsoleWriter::run()
+{
+    QQueue<Entry> pending;
+    forever {
+        bool stopping;
+        {
+            QMutexLocker locker(&m_mutex);
+            while (m_queue.isEmpty() && !m_stopping)
+                m_condition.wait(&m_mutex);
+            // Give more messages a chance to arrive so they share one write.
+            if (!m_stopping && m_flushInterval > 0 && m_queue.count() < m_maxQueueSize / 2)
+                m_condition.wait(&m_mutex, m_flushInterval);
+            pending = m_queue;
+            m_queue.clear();
+            stopping = m_stopping;
+        }
+
+        if (!pending.isEmpty()) {
+            QByteArray data;
+            while (!pending.isEmpty())
+                data += format(pending.dequeue());
+            fwrite(data.constData(), 1, data.size(), stdout);
+            fflush(stdout);
+        }
+
+        if (stopping)
+            return;
+    }
+}
+
+QByteArray ConsoleWriter::format(const Entry &entry) const
+{
+    if (m_format == JsonLines) {
+        QByteArray result("{\"timestamp\":");
+        result += QByteArray::number(entry.timestamp);
+        result += ",\"type\":";
+        appendJsonString(result, entry.type);
+        if (!entry.source.isEmpty()) {
+            result += ",\"source\":";
+            appendJsonString(result, entry.source);
+            result += ",\"line\":" + QByteArray::number(entry.line);
+        }
+        result += ",\"message\":";
+        appendJsonString(result, entry.message);
+        result += "}\n";
+        return result;
+    }
+
+    QByteArray result;
+    if (entry.type == "alert")
+        result += "JavaScript alert: ";
+    else if (entry.type == "interrupt")
+        result += "JavaScript interrupted: ";
+    else if (!entry.source.isEmpty())
+        result += entry.source.toLocal8Bit() + ":" + QByteArray::number(entry.line) + " ";
+    result += entry.message.toLocal8Bit();
+    result += '\n';
+    return result;
+}
@@ -0,0 +1,86 @@
+/*
+  This file is part of the PhantomJS project from Ofi Labs.
+
+  Copyright (C) 2011 Ariya Hidayat <ariya.hidayat@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CONSOLEWRITER_H
+#define CONSOLEWRITER_H
+
+#include <QMutex>
+#include <QQueue>
+#include <QThread>
+#include <QWaitCondition>
+
+// Collects console and alert messages from the page and writes them to the
+// standard output on a background thread, so that scripts which log a lot
+// neither pay for a flush per message nor block on a slow consumer.
+class ConsoleWriter: public QThread
+{
+public:
+    enum Format {
+        PlainText,
+        JsonLines
+    };
+
+    ConsoleWriter(QObject *parent = 0);
+    ~ConsoleWriter();
+
+    void setFlushInterval(int ms);
+    void setMaxQueueSize(int size);
+    void setFormat(Format format);
+
+    void write(const QString &type, const QString &message,
+               const QString &source = QString(), int line = -1);
+    quint64 droppedCount() const;
+
+    void stop();
+
+protected:
+    void run();
+
+private:
+    struct Entry {
+        qint64 timestamp;
+        QString type;
+        QString message;
+        QString source;
+        int line;
+    };
+
+    QByteArray format(const Entry &entry) const;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_condition;
+    QQueue<Entry> m_queue;
+    quint64 m_dropped;
+    bool m_stopping;
+    int m_flushInterval;
+    int m_maxQueueSize;
+    Format m_format;
+};
+
+#endif // CONSOLEWRITER_H
@@ -0,0 +1,565 @@
+/*
+  This file is part of the PhantomJS project from Ofi Labs.
+
+  Copyright (C) 2011 Ariya Hidayat <ariya.hidayat@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "cookiejar.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QMap>
+#include <QStringList>
+#include <QTemporaryFile>
+#include <QUrl>
+#include <QtAlgorithms>
+
+#include <errno.h>
+#include <stdio.h>
+
+#ifdef Q_OS_UNIX
+#include <sys/file.h>
+#include <sys/stat.h>
+#endif
+
+// The cookies file is an append-only journal: every line is one cookie in
+// Set-Cookie form, and a later line for the same (domain, path, name)
+// replaces an earlier one. Deletions are recorded as already expired
+// cookies. Appending keeps each update O(1); the file is rewritten with
+// only the live cookies once the journal grows well past the jar.
+//
+// Several processes may share one journal. Appends and compactions hold an
+// exclusive lock on it, and a compaction first reads back what the others
+// appended, so that rewriting the file never loses their records.
+static const int MinCompactionRecords = 1000;
+
+// Expired cookies are skipped on lookup and dropped from the buckets at
+// most this often.
+static const int PurgeIntervalSecs = 60;
+
+// QNetworkCookieJar is used for nothing but its acceptance rules, which
+// include the effective TLD check it does not expose otherwise. It never
+// holds more than the one cookie being checked.
+class CookieValidator: public QNetworkCookieJar
+{
+public:
+    CookieValidator(QObject *parent)
+        : QNetworkCookieJar(parent)
+    {
+    }
+
+    bool normalize(QNetworkCookie *cookie, const QUrl &url)
+    {
+        // Expired cookies are deletions, which the base class never reports
+        // as accepted, so the check runs on a session copy.
+        QNetworkCookie probe = *cookie;
+        probe.setExpirationDate(QDateTime());
+
+        setAllCookies(QList<QNetworkCookie>());
+        if (!QNetworkCookieJar::setCookiesFromUrl(QList<QNetworkCookie>() << probe, url))
+            return false;
+        const QNetworkCookie accepted = allCookies().first();
+        setAllCookies(QList<QNetworkCookie>());
+
+        cookie->setDomain(accepted.domain());
+        cookie->setPath(accepted.path());
+        return true;
+    }
+};
+
+static inline QString domainKey(const QString &domain)
+{
+    return domain.toLower();
+}
+
+static QString cookieKey(const QNetworkCookie &cookie)
+{
+    return domainKey(cookie.domain()) + QLatin1Char('\t') + cookie.path() + QLatin1Char('\t') + QString::fromLatin1(cookie.name());
+}
+
+static bool isExpired(const QNetworkCookie &cookie, const QDateTime &now)
+{
+    return !cookie.isSessionCookie() && cookie.expirationDate() < now;
+}
+
+// The last record for every cookie in the journal, deletions included. A
+// line without its newline may still be in the middle of being appended by
+// another process, so only complete lines are used.
+static QMap<QString, QNetworkCookie> readJournal(const QString &fileName, int *records)
+{
+    QMap<QString, QNetworkCookie> cookies;
+    *records = 0;
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly))
+        return cookies;
+    const QByteArray data = file.readAll();
+    file.close();
+
+    int start = 0;
+    int end;
+    while ((end = data.indexOf('\n', start)) >= 0) {
+        const QByteArray line = data.mid(start, end - start);
+        start = end + 1;
+        foreach (const QNetworkCookie &cookie, QNetworkCookie::parseCookies(line))
+            cookies.insert(cookieKey(cookie), cookie);
+        ++*records;
+    }
+    return cookies;
+}
+
+static bool isParentPath(QString path, QString reference)
+{
+    if (!path.endsWith(QLatin1Char('/')))
+        path += QLatin1Char('/');
+    if (!reference.endsWith(QLatin1Char('/')))
+        reference += QLatin1Char('/');
+    return path.startsWith(reference);
+}
+
+static bool longerPathFirst(const QNetworkCookie &a, const QNetworkCookie &b)
+{
+    return a.path().length() > b.path().length();
+}
+
+static QVariantMap cookieToMap(const QNetworkCookie &cookie)
+{
+    QVariantMap cookieEntry;
+    cookieEntry["domain"] = cookie.domain();
+    cookieEntry["name"] = QString(cookie.name());
+    cookieEntry["value"] = QString(cookie.value());
+    cookieEntry["path"] = cookie.path();
+
+    if (!cookie.isSessionCookie())
+        cookieEntry["expiration"] = cookie.expirationDate().toString("ddd, dd-MMM-yyyy hh:mm:ss 'GMT'");
+    if (cookie.isHttpOnly())
+        cookieEntry["httponly"] = true;
+    if (cookie.isSecure())
+        cookieEntry["secure"] = true;
+
+    return cookieEntry;
+}
+
+static bool cookieFromMap(const QVariantMap &cookieEntry, QNetworkCookie *cookie)
+{
+    if (!cookieEntry.contains("domain")) return false;
+    cookie->setDomain(cookieEntry.value("domain").toString());
+
+    if(!cookieEntry.contains("name")) return false;
+    cookie->setName(cookieEntry.value("name").toByteArray());
+
+    if(!cookieEntry.contains("value")) return false;
+    cookie->setValue(cookieEntry.value("value").toByteArray());
+
+    if (!cookieEntry.contains("path")) return false;
+    cookie->setPath(cookieEntry.value("path").toString());
+
+    if (cookieEntry.contains("expiration"))
+        cookie->setExpirationDate(QDateTime::fromString(cookieEntry.value("expiration").toString(), "ddd, dd-MMM-yyyy hh:mm:ss 'GMT'"));
+
+    if (cookieEntry.contains("httponly"))
+        cookie->setHttpOnly(cookieEntry.value("httponly").toBool());
+
+    if (cookieEntry.contains("secure"))
+        cookie->setSecure(cookieEntry.value("secure").toBool());
+
+    return true;
+}
+
+NetworkCookieJar::NetworkCookieJar(QObject *parent)
+    : QNetworkCookieJar(parent)
+    , m_validator(new CookieValidator(this))
+    , m_count(0)
+    , m_lastPurge(QDateTime::currentDateTime())
+    , m_journalRecords(0)
+{
+}
+
+NetworkCookieJar::~NetworkCookieJar()
+{
+    if (m_journal.isOpen() && m_journalRecords > m_count)
+        compact(MergeJournal);
+}
+
+QVariantList NetworkCookieJar::cookies() const
+{
+    QVariantList result;
+    foreach (const QNetworkCookie& cookie, storedCookies())
+        result.append(cookieToMap(cookie));
+    return result;
+}
+
+bool NetworkCookieJar::setCookies(const QVariantList& cookies)
+{
+    QList<QNetworkCookie> newCookies;
+    foreach (const QVariant& listItem, cookies) {
+        if (!listItem.canConvert(QVariant::Map)) return false;
+        QNetworkCookie cookie;
+        if (!cookieFromMap(listItem.toMap(), &cookie)) return false;
+        newCookies.append(cookie);
+    }
+
+    replaceAll(newCookies);
+
+    // The whole jar was replaced, so the journal starts over as well.
+    if (m_journal.isOpen())
+        compact(ReplaceJournal);
+    return true;
+}
+
+bool NetworkCookieJar::addCookie(const QVariantMap &cookieEntry)
+{
+    QNetworkCookie cookie;
+    if (!cookieFromMap(cookieEntry, &cookie))
+        return false;
+
+    if (isExpired(cookie, QDateTime::currentDateTime())) {
+        if (removeCookie(cookie.domain(), cookie.path(), cookie.name()))
+            appendRecord(cookie);
+        return false;
+    }
+
+    insertCookie(cookie);
+    appendRecord(cookie);
+    compactIfNeeded();
+    return true;
+}
+
+bool NetworkCookieJar::deleteCookie(const QString &name, const QString &domain, const QString &path)
+{
+    if (!removeCookie(domain, path, name.toLatin1()))
+        return false;
+
+    QNetworkCookie deletion(name.toLatin1());
+    deletion.setDomain(domain);
+    deletion.setPath(path);
+    deletion.setExpirationDate(QDateTime::fromTime_t(0));
+    appendRecord(deletion);
+    compactIfNeeded();
+    return true;
+}
+
+QVariantList NetworkCookieJar::cookiesForUrlMaps(const QUrl &url) const
+{
+    QVariantList result;
+    foreach (const QNetworkCookie &cookie, cookiesForUrl(url))
+        result.append(cookieToMap(cookie));
+    return result;
+}
+
+QList<QNetworkCookie> NetworkCookieJar::storedCookies() const
+{
+    const QDateTime now = QDateTime::currentDateTime();
+    QList<QNetworkCookie> result;
+    QHash<QString, QList<QNetworkCookie> >::const_iterator it;
+    for (it = m_cookiesByDomain.constBegin(); it != m_cookiesByDomain.constEnd(); ++it) {
+        foreach (const QNetworkCookie &cookie, it.value()) {
+            if (!isExpired(cookie, now))
+                result += cookie;
+        }
+    }
+    return result;
+}
+
+// Unlike setCookies(), the cookies already in the jar are kept unless one
+// of the new ones replaces them.
+void NetworkCookieJar::mergeCookies(const QList<QNetworkCookie> &cookies)
+{
+    const QDateTime now = QDateTime::currentDateTime();
+    foreach (const QNetworkCookie &cookie, cookies) {
+        if (isExpired(cookie, now))
+            continue;
+        insertCookie(cookie);
+        appendRecord(cookie);
+    }
+    compactIfNeeded();
+}
+
+int NetworkCookieJar::count() const
+{
+    return m_count;
+}
+
+void NetworkCookieJar::purgeExpired()
+{
+    const QDateTime now = QDateTime::currentDateTime();
+    QHash<QString, QList<QNetworkCookie> >::iterator it = m_cookiesByDomain.begin();
+    while (it != m_cookiesByDomain.end()) {
+        QList<QNetworkCookie> &bucket = it.value();
+        for (int i = bucket.count() - 1; i >= 0; --i) {
+            if (isExpired(bucket.at(i), now)) {
+                bucket.removeAt(i);
+                --m_count;
+            }
+        }
+        if (bucket.isEmpty())
+            it = m_cookiesByDomain.erase(it);
+        else
+            ++it;
+    }
+    m_lastPurge = now;
+}
+
+QList<QNetworkCookie> NetworkCookieJar::cookiesForUrl(const QUrl &url) const
+{
+    const QDateTime now = QDateTime::currentDateTime();
+    const bool isEncrypted = url.scheme().toLower() == QLatin1String("https");
+    const QString host = domainKey(url.host());
+    const QString path = url.path();
+
+    // A host-only cookie is stored under the host itself; domain cookies
+    // carry a leading dot and match the host and all of its subdomains.
+    QStringList candidates;
+    candidates += host;
+    candidates += QLatin1Char('.') + host;
+    int dot = host.indexOf(QLatin1Char('.'));
+    while (dot >= 0) {
+        candidates += host.mid(dot);
+        dot = host.indexOf(QLatin1Char('.'), dot + 1);
+    }
+
+    QList<QNetworkCookie> result;
+    foreach (const QString &domain, candidates) {
+        QHash<QString, QList<QNetworkCookie> >::const_iterator bucket = m_cookiesByDomain.constFind(domain);
+        if (bucket == m_cookiesByDomain.constEnd())
+            continue;
+        foreach (const QNetworkCookie &cookie, bucket.value()) {
+            if (!isParentPath(path, cookie.path()))
+                continue;
+            if (isExpired(cookie, now))
+                continue;
+            if (cookie.isSecure() && !isEncrypted)
+                continue;
+            result += cookie;
+        }
+    }
+
+    // Same order as QNetworkCookieJar: the most specific path first.
+    qStableSort(result.begin(), result.end(), longerPathFirst);
+    return result;
+}
+
+bool NetworkCookieJar::setCookiesFromUrl(const QList<QNetworkCookie> &cookieList, const QUrl &url)
+{
+    const QDateTime now = QDateTime::currentDateTime();
+    bool added = false;
+    foreach (QNetworkCookie cookie, cookieList) {
+        if (!m_validator->normalize(&cookie, url))
+            continue;
+
+        if (isExpired(cookie, now)) {
+            // Deletions are only journaled when they remove something.
+            if (removeCookie(cookie.domain(), cookie.path(), cookie.name()))
+                appendRecord(cookie);
+            continue;
+        }
+
+        insertCookie(cookie);
+        appendRecord(cookie);
+        added = true;
+    }
+
+    if (m_lastPurge.secsTo(now) > PurgeIntervalSecs)
+        purgeExpired();
+    compactIfNeeded();
+    return added;
+}
+
+void NetworkCookieJar::replaceAll(const QList<QNetworkCookie> &cookies)
+{
+    m_cookiesByDomain.clear();
+    m_count = 0;
+    foreach (const QNetworkCookie &cookie, cookies)
+        insertCookie(cookie);
+}
+
+void NetworkCookieJar::insertCookie(const QNetworkCookie &cookie)
+{
+    QList<QNetworkCookie> &bucket = m_cookiesByDomain[domainKey(cookie.domain())];
+    for (int i = 0; i < bucket.count(); ++i) {
+        const QNetworkCookie &current = bucket.at(i);
+        if (current.name() == cookie.name() && current.path() == cookie.path()) {
+            bucket[i] = cookie;
+            return;
+        }
+    }
+    bucket += cookie;
+    ++m_count;
+}
+
+bool NetworkCookieJar::removeCookie(const QString &domain, const QString &path, const QByteArray &name)
+{
+    QHash<QString, QList<QNetworkCookie> >::iterator it = m_cookiesByDomain.find(domainKey(domain));
+    if (it == m_cookiesByDomain.end())
+        return false;
+
+    QList<QNetworkCookie> &bucket = it.value();
+    for (int i = 0; i < bucket.count(); ++i) {
+        if (bucket.at(i).name() == name && bucket.at(i).path() == path) {
+            bucket.removeAt(i);
+            --m_count;
+            if (bucket.isEmpty())
+                m_cookiesByDomain.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool NetworkCookieJar::setCookiesFile(const QString &fileName)
+{
+    m_journal.close();
+    m_journal.setFileName(fileName);
+    m_journalRecords = 0;
+
+    QFileInfo fileInfo(fileName);
+    QDir().mkpath(fileInfo.absolutePath());
+
+    const QMap<QString, QNetworkCookie> cookies = readJournal(fileName, &m_journalRecords);
+
+    const QDateTime now = QDateTime::currentDateTime();
+    QList<QNetworkCookie> liveCookies;
+    foreach (const QNetworkCookie &cookie, cookies) {
+        if (!isExpired(cookie, now))
+            liveCookies += cookie;
+    }
+    replaceAll(liveCookies);
+
+    if (!m_journal.open(QFile::WriteOnly | QFile::Append | QFile::Unbuffered))
+        return false;
+    compactIfNeeded();
+    return m_journal.isOpen();
+}
+
+// A compaction replaces the file, so a lock only counts while the locked
+// file is still the one at the journal's path. Otherwise the journal is
+// reopened, which also makes later appends go to the new file.
+bool NetworkCookieJar::lockJournal()
+{
+#ifdef Q_OS_UNIX
+    const QByteArray path = QFile::encodeName(m_journal.fileName());
+    forever {
+        if (!m_journal.isOpen() && !m_journal.open(QFile::WriteOnly | QFile::Append | QFile::Unbuffered))
+            return false;
+        if (::flock(m_journal.handle(), LOCK_EX) != 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        struct stat opened;
+        struct stat current;
+        if (::fstat(m_journal.handle(), &opened) == 0 && ::stat(path.constData(), &current) == 0
+                && opened.st_dev == current.st_dev && opened.st_ino == current.st_ino)
+            return true;
+        // Closing the stale file also releases its lock.
+        m_journal.close();
+    }
+#else
+    return m_journal.isOpen();
+#endif
+}
+
+void NetworkCookieJar::unlockJournal()
+{
+#ifdef Q_OS_UNIX
+    ::flock(m_journal.handle(), LOCK_UN);
+#endif
+}
+
+void NetworkCookieJar::appendRecord(const QNetworkCookie &cookie)
+{
+    if (!m_journal.isOpen())
+        return;
+
+    // One write per record keeps concurrent readers from seeing half a line
+    // on local file systems.
+    QByteArray line = cookie.toRawForm(QNetworkCookie::Full);
+    line += '\n';
+    if (!lockJournal())
+        return;
+    m_journal.write(line);
+    unlockJournal();
+    ++m_journalRecords;
+}
+
+void NetworkCookieJar::compactIfNeeded()
+{
+    if (m_journal.isOpen() && m_journalRecords > 2 * m_count + MinCompactionRecords)
+        compact(MergeJournal);
+}
+
+void NetworkCookieJar::compact(CompactionMode mode)
+{
+    if (!lockJournal())
+        return;
+    const QString fileName = m_journal.fileName();
+
+    // The jar picks up whatever other processes appended since it loaded
+    // the journal, since the rewritten file has to keep it.
+    if (mode == MergeJournal) {
+        int journalRecords;
+        const QDateTime now = QDateTime::currentDateTime();
+        QList<QNetworkCookie> liveCookies;
+        foreach (const QNetworkCookie &cookie, readJournal(fileName, &journalRecords)) {
+            if (!isExpired(cookie, now))
+                liveCookies += cookie;
+        }
+        replaceAll(liveCookies);
+    }
+
+    QByteArray data;
+    int records = 0;
+    foreach (const QNetworkCookie &cookie, storedCookies()) {
+        data += cookie.toRawForm(QNetworkCookie::Full);
+        data += '\n';
+        ++records;
+    }
+
+    // Readers keep seeing either the old or the new file, never a partial
+    // one: the new content is written aside and then renamed over it.
+    QTemporaryFile temp(fileName + ".XXXXXX");
+    if (!temp.open() || temp.write(data) != data.size()) {
+        unlockJournal();
+        return;
+    }
+    temp.setPermissions(m_journal.permissions());
+    temp.close();
+#ifdef Q_OS_UNIX
+    const bool replaced = ::rename(QFile::encodeName(temp.fileName()).constData(), QFile::encodeName(fileName).constData()) == 0;
+#else
+    QFile::remove(fileName);
+    const bool replaced = QFile::rename(temp.fileName(), fileName);
+#endif
+    if (!replaced) {
+        unlockJournal();
+        return;
+    }
+
+    // Processes waiting for the lock find the old file replaced and reopen
+    // the journal, as does this one.
+    m_journalRecords = records;
+    m_journal.close();
+    m_journal.open(QFile::WriteOnly | QFile::Append | QFile::Unbuffered);
+}
@@ -0,0 +1,93 @@
+/*
+  This file is part of the PhantomJS project from Ofi Labs.
+
+  Copyright (C) 2011 Ariya Hidayat <ariya.hidayat@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef COOKIEJAR_H
+#define COOKIEJAR_H
+
+#include <QDateTime>
+#include <QFile>
+#include <QHash>
+#include <QNetworkCookie>
+#include <QNetworkCookieJar>
+#include <QVariantList>
+
+class CookieValidator;
+
+// Cookies are kept in buckets keyed by their domain attribute. A request
+// only looks at the buckets for its host and the host's parent domains
+// instead of scanning every cookie in the jar.
+class NetworkCookieJar: public QNetworkCookieJar
+{
+public:
+    NetworkCookieJar(QObject *parent = 0);
+    ~NetworkCookieJar();
+
+    QVariantList cookies() const;
+    bool setCookies(const QVariantList& cookies);
+
+    bool addCookie(const QVariantMap &cookie);
+    bool deleteCookie(const QString &name, const QString &domain, const QString &path);
+    QVariantList cookiesForUrlMaps(const QUrl &url) const;
+
+    QList<QNetworkCookie> storedCookies() const;
+    void mergeCookies(const QList<QNetworkCookie> &cookies);
+    int count() const;
+    void purgeExpired();
+
+    bool setCookiesFile(const QString &fileName);
+
+    QList<QNetworkCookie> cookiesForUrl(const QUrl &url) const;
+    bool setCookiesFromUrl(const QList<QNetworkCookie> &cookieList, const QUrl &url);
+
+private:
+    void replaceAll(const QList<QNetworkCookie> &cookies);
+    void insertCookie(const QNetworkCookie &cookie);
+    bool removeCookie(const QString &domain, const QString &path, const QByteArray &name);
+
+    enum CompactionMode {
+        MergeJournal,
+        ReplaceJournal
+    };
+
+    bool lockJournal();
+    void unlockJournal();
+    void appendRecord(const QNetworkCookie &cookie);
+    void compactIfNeeded();
+    void compact(CompactionMode mode);
+
+    CookieValidator *m_validator;
+    QHash<QString, QList<QNetworkCookie> > m_cookiesByDomain;
+    int m_count;
+    QDateTime m_lastPurge;
+
+    QFile m_journal;
+    int m_journalRecords;
+};
+
+#endif // COOKIEJAR_H
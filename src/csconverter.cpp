@@ -31,30 +31,105 @@
 
 #include <iostream>
 
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDir>
 #include <QFile>
-#include <QWebFrame>
+#include <QScriptEngine>
 #include <QDebug>
 
+#include <stdio.h>
+
 CSConverter::CSConverter(QObject *parent)
     : QObject(parent)
+    , m_engine(0)
 {
     QFile file(":/coffee-script.js");
     if (!file.open(QFile::ReadOnly)) {
         qFatal("CoffeeScript compiler is not available!");
         exit(1);
     }
-    QString script = QString::fromUtf8(file.readAll());
+    m_compiler = file.readAll();
     file.close();
-    m_webPage.mainFrame()->evaluateJavaScript(script);
-    m_webPage.mainFrame()->addToJavaScriptWindowObject("converter", this);
+}
+
+// The compiler is loaded once per process and shared by every caller.
+CSConverter *CSConverter::instance()
+{
+    static CSConverter *converter = 0;
+    if (!converter)
+        converter = new CSConverter(QCoreApplication::instance());
+    return converter;
+}
+
+void CSConverter::setCacheDirectory(const QString &path)
+{
+    m_cacheDirectory = path;
+}
+
+// Compiled scripts are cached under a hash of the source and of the
+// compiler itself, so a different bundled compiler never reuses old output.
+QByteArray CSConverter::cacheKey(const QString &script) const
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(QCryptographicHash::hash(m_compiler, QCryptographicHash::Sha1));
+    hash.addData(script.toUtf8());
+    return hash.result().toHex();
 }
 
 QString CSConverter::convert(const QString &script)
 {
-    setProperty("source", script);
-    QWebFrame *frame = m_webPage.mainFrame();
-    QVariant result = frame->evaluateJavaScript("this.CoffeeScript.compile(converter.source)");
-    if (result.type() == QVariant::String)
+    if (m_cacheDirectory.isEmpty())
+        return compile(script);
+
+    const QString fileName = m_cacheDirectory + "/" + QString::fromLatin1(cacheKey(script)) + ".js";
+    QFile cached(fileName);
+    if (cached.open(QFile::ReadOnly))
+        return QString::fromUtf8(cached.readAll());
+
+    const QString result = compile(script);
+    if (result.isEmpty())
+        return result;
+
+    // Write aside and rename, so that a concurrent run never reads a
+    // partially written entry.
+    QDir().mkpath(m_cacheDirectory);
+    const QString tempName = fileName + QString(".%1.tmp").arg(QCoreApplication::applicationPid());
+    QFile temp(tempName);
+    if (temp.open(QFile::WriteOnly | QFile::Truncate)) {
+        temp.write(result.toUtf8());
+        temp.close();
+#ifdef Q_OS_UNIX
+        ::rename(QFile::encodeName(tempName).constData(), QFile::encodeName(fileName).constData());
+#else
+        if (!QFile::rename(tempName, fileName))
+            QFile::remove(tempName);
+#endif
+    }
+    return result;
+}
+
+QString CSConverter::compile(const QString &script)
+{
+    // Loading the compiler is the expensive part, so it only happens for
+    // scripts that are not in the cache.
+    if (!m_engine) {
+        m_engine = new QScriptEngine(this);
+        m_engine->evaluate(QString::fromUtf8(m_compiler), "coffee-script.js");
+        m_compile = m_engine->globalObject().property("CoffeeScript").property("compile");
+        if (!m_compile.isFunction()) {
+            qFatal("CoffeeScript compiler is not available!");
+            exit(1);
+        }
+    }
+
+    QScriptValue result = m_compile.call(QScriptValue(), QScriptValueList() << QScriptValue(m_engine, script));
+    if (m_engine->hasUncaughtException()) {
+        std::cerr << "CoffeeScript: " << qPrintable(result.toString()) << std::endl;
+        m_engine->clearExceptions();
+        return QString();
+    }
+    if (result.isString())
         return result.toString();
     return QString();
 }
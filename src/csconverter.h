@@ -31,16 +31,30 @@
 #define CSCONVERTER_H
 
 #include <QObject>
-#include <QWebPage>
+#include <QScriptValue>
 
+class QScriptEngine;
+
+// Compiles CoffeeScript with the bundled compiler running in a bare
+// QScriptEngine; no web page, DOM or network stack is involved.
 class CSConverter: public QObject
 {
 public:
     CSConverter(QObject *parent = 0);
+
+    static CSConverter *instance();
+
+    void setCacheDirectory(const QString &path);
     QString convert(const QString &script);
 
 private:
-    QWebPage m_webPage;
+    QByteArray cacheKey(const QString &script) const;
+    QString compile(const QString &script);
+
+    QString m_cacheDirectory;
+    QByteArray m_compiler;
+    QScriptEngine *m_engine;
+    QScriptValue m_compile;
 };
 
 #endif // CSCONVERTER_H
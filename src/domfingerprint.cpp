@@ -0,0 +1,268 @@
+/*
+  This file is part of the PhantomJS project from Ofi Labs.
+
+  Copyright (C) 2011 Ariya Hidayat <ariya.hidayat@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "domfingerprint.h"
+
+#include <QtEndian>
+
+#include <string.h>
+
+static const quint64 Prime1 = Q_UINT64_C(11400714785074694791);
+static const quint64 Prime2 = Q_UINT64_C(14029467366897019727);
+static const quint64 Prime3 = Q_UINT64_C(1609587929392839161);
+static const quint64 Prime4 = Q_UINT64_C(9650029242287828579);
+static const quint64 Prime5 = Q_UINT64_C(2870177450012600261);
+
+static inline quint64 rotateLeft(quint64 value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline quint64 accumulate(quint64 accumulator, quint64 input)
+{
+    accumulator += input * Prime2;
+    accumulator = rotateLeft(accumulator, 31);
+    return accumulator * Prime1;
+}
+
+static inline quint64 mergeRound(quint64 hash, quint64 accumulator)
+{
+    hash ^= accumulate(0, accumulator);
+    return hash * Prime1 + Prime4;
+}
+
+XXHash64::XXHash64(quint64 seed)
+    : m_seed(seed)
+    , m_bufferSize(0)
+    , m_totalSize(0)
+{
+    m_state[0] = seed + Prime1 + Prime2;
+    m_state[1] = seed + Prime2;
+    m_state[2] = seed;
+    m_state[3] = seed - Prime1;
+}
+
+void XXHash64::update(const void *data, int size)
+{
+    const uchar *input = static_cast<const uchar*>(data);
+    const uchar *end = input + size;
+    m_totalSize += size;
+
+    if (m_bufferSize + size < 32) {
+        memcpy(m_buffer + m_bufferSize, input, size);
+        m_bufferSize += size;
+        return;
+    }
+
+    if (m_bufferSize) {
+        const int fill = 32 - m_bufferSize;
+        memcpy(m_buffer + m_bufferSize, input, fill);
+        input += fill;
+        for (int i = 0; i < 4; ++i)
+            m_state[i] = accumulate(m_state[i], qFromLittleEndian<quint64>(m_buffer + 8 * i));
+        m_bufferSize = 0;
+    }
+
+    while (end - input >= 32) {
+        for (int i = 0; i < 4; ++i)
+            m_state[i] = accumulate(m_state[i], qFromLittleEndian<quint64>(input + 8 * i));
+        input += 32;
+    }
+
+    m_bufferSize = end - input;
+    memcpy(m_buffer, input, m_bufferSize);
+}
+
+quint64 XXHash64::digest() const
+{
+    quint64 hash;
+    if (m_totalSize >= 32) {
+        hash = rotateLeft(m_state[0], 1) + rotateLeft(m_state[1], 7)
+                + rotateLeft(m_state[2], 12) + rotateLeft(m_state[3], 18);
+        for (int i = 0; i < 4; ++i)
+            hash = mergeRound(hash, m_state[i]);
+    } else {
+        hash = m_seed + Prime5;
+    }
+    hash += m_totalSize;
+
+    const uchar *input = m_buffer;
+    const uchar *end = m_buffer + m_bufferSize;
+    while (end - input >= 8) {
+        hash ^= accumulate(0, qFromLittleEndian<quint64>(input));
+        hash = rotateLeft(hash, 27) * Prime1 + Prime4;
+        input += 8;
+    }
+    if (end - input >= 4) {
+        hash ^= quint64(qFromLittleEndian<quint32>(input)) * Prime1;
+        hash = rotateLeft(hash, 23) * Prime2 + Prime3;
+        input += 4;
+    }
+    while (input < end) {
+        hash ^= *input * Prime5;
+        hash = rotateLeft(hash, 11) * Prime1;
+        ++input;
+    }
+
+    hash ^= hash >> 33;
+    hash *= Prime2;
+    hash ^= hash >> 29;
+    hash *= Prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+// The text of an element's own text nodes, with a number in place of each
+// child element. Wrapped in a function to leave the page's globals alone.
+static const char ChildNodesScript[] =
+    "(function (element) {"
+    "    var nodes = [];"
+    "    for (var node = element.firstChild; node; node = node.nextSibling) {"
+    "        if (node.nodeType == 1)"
+    "            nodes.push(0);"
+    "        else if (node.nodeType == 3)"
+    "            nodes.push(node.data);"
+    "    }"
+    "    return nodes;"
+    "})(this)";
+
+DomFingerprint::DomFingerprint(const QWebElement &root, const QStringList &attributes)
+    : m_root(root)
+    , m_attributes(attributes)
+{
+}
+
+void DomFingerprint::ignore(const QStringList &selectors)
+{
+    foreach (const QString &selector, selectors) {
+        foreach (const QByteArray &path, pathsOf(m_root.findAll(selector))) {
+            m_ignored += path;
+            m_ignoredAncestors += QByteArray();
+            for (int i = 0; i < path.size() - 1; ++i) {
+                if (path.at(i) == '/')
+                    m_ignoredAncestors += path.left(i + 1);
+            }
+        }
+    }
+}
+
+void DomFingerprint::add()
+{
+    addElement(m_root, QByteArray(), true);
+}
+
+void DomFingerprint::add(const QString &selector)
+{
+    const QWebElementCollection elements = m_root.findAll(selector);
+    const QList<QByteArray> paths = pathsOf(elements);
+    for (int i = 0; i < paths.count(); ++i) {
+        if (!m_ignored.contains(paths.at(i)))
+            addElement(elements.at(i), paths.at(i), true);
+    }
+}
+
+QString DomFingerprint::result() const
+{
+    return QString("%1").arg(m_hash.digest(), 16, 16, QLatin1Char('0'));
+}
+
+// A path lists the child indices from the root down, each followed by a
+// slash; the root's own path is empty. The collection is in document order,
+// so one walk of the tree finds all of them.
+QList<QByteArray> DomFingerprint::pathsOf(const QWebElementCollection &elements) const
+{
+    QList<QByteArray> paths;
+    int next = 0;
+    findPaths(m_root, QByteArray(), elements, &next, &paths);
+    return paths;
+}
+
+void DomFingerprint::findPaths(const QWebElement &element, const QByteArray &path,
+                               const QWebElementCollection &elements, int *next, QList<QByteArray> *paths) const
+{
+    if (*next == elements.count())
+        return;
+    if (element == elements.at(*next)) {
+        *paths += path;
+        ++*next;
+    }
+    int index = 0;
+    for (QWebElement child = element.firstChild(); !child.isNull() && *next < elements.count(); child = child.nextSibling())
+        findPaths(child, path + QByteArray::number(index++) + '/', elements, next, paths);
+}
+
+// The text of a subtree is taken in one piece from its root, unless
+// something inside is ignored: then the element's own text nodes are
+// hashed one by one between its children, and the children take their
+// text themselves.
+void DomFingerprint::addElement(const QWebElement &element, const QByteArray &path, bool withText)
+{
+    addString(element.tagName());
+    foreach (const QString &name, m_attributes) {
+        if (element.hasAttribute(name)) {
+            addString(name);
+            addString(element.attribute(name));
+        }
+    }
+
+    QVariantList nodes;
+    bool childText = false;
+    if (withText) {
+        if (m_ignoredAncestors.contains(path)) {
+            nodes = element.evaluateJavaScript(ChildNodesScript).toList();
+            childText = true;
+        } else {
+            addString(element.toPlainText());
+        }
+    }
+
+    int node = 0;
+    int index = 0;
+    for (QWebElement child = element.firstChild(); !child.isNull(); child = child.nextSibling()) {
+        for (; node < nodes.count() && nodes.at(node).type() == QVariant::String; ++node)
+            addString(nodes.at(node).toString());
+        ++node;
+        const QByteArray childPath = path + QByteArray::number(index++) + '/';
+        if (!m_ignored.contains(childPath))
+            addElement(child, childPath, childText);
+    }
+    for (; node < nodes.count(); ++node)
+        addString(nodes.at(node).toString());
+
+    // Closes the element, so that moving one changes the hash.
+    static const char end = '\1';
+    m_hash.update(&end, 1);
+}
+
+void DomFingerprint::addString(const QString &string)
+{
+    static const ushort separator = 0;
+    m_hash.update(string.constData(), string.size() * sizeof(QChar));
+    m_hash.update(&separator, sizeof(separator));
+}
@@ -0,0 +1,86 @@
+/*
+  This file is part of the PhantomJS project from Ofi Labs.
+
+  Copyright (C) 2011 Ariya Hidayat <ariya.hidayat@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DOMFINGERPRINT_H
+#define DOMFINGERPRINT_H
+
+#include <QList>
+#include <QSet>
+#include <QStringList>
+#include <QWebElement>
+#include <QWebElementCollection>
+
+// 64-bit xxHash, fed incrementally.
+class XXHash64
+{
+public:
+    XXHash64(quint64 seed = 0);
+
+    void update(const void *data, int size);
+    quint64 digest() const;
+
+private:
+    quint64 m_seed;
+    quint64 m_state[4];
+    uchar m_buffer[32];
+    int m_bufferSize;
+    quint64 m_totalSize;
+};
+
+// Hashes the tag names, the given attributes and the text of an element
+// tree without serializing it. Subtrees matched by an ignored selector do
+// not contribute at all.
+//
+// Elements are told apart by their path of child indices below the root,
+// so that the page's DOM is only read, never marked.
+class DomFingerprint
+{
+public:
+    DomFingerprint(const QWebElement &root, const QStringList &attributes = QStringList());
+
+    void ignore(const QStringList &selectors);
+    void add();
+    void add(const QString &selector);
+    QString result() const;
+
+private:
+    QList<QByteArray> pathsOf(const QWebElementCollection &elements) const;
+    void findPaths(const QWebElement &element, const QByteArray &path,
+                   const QWebElementCollection &elements, int *next, QList<QByteArray> *paths) const;
+    void addElement(const QWebElement &element, const QByteArray &path, bool withText);
+    void addString(const QString &string);
+
+    QWebElement m_root;
+    QStringList m_attributes;
+    QSet<QByteArray> m_ignored;
+    QSet<QByteArray> m_ignoredAncestors;
+    XXHash64 m_hash;
+};
+
+#endif // DOMFINGERPRINT_H
@@ -31,25 +31,31 @@
 
 #include "gif_lib.h"
 
+#include <QByteArray>
 #include <QImage>
 #include <QFile>
 
+#include <limits.h>
+
+// The encoder flushes at most 256 bytes at a time, so the output is collected
+// in memory and written out at once instead of one small write per block.
 static int saveGifBlock(GifFileType *gif, const GifByteType *data, int i)
 {
-    QFile *file = (QFile*)(gif->UserData);
-    return file->write((const char*)data, i);
+    QByteArray *buffer = (QByteArray*)(gif->UserData);
+    buffer->append((const char*)data, i);
+    return i;
 }
 
-bool exportGif(const QImage &img, const QString &fileName)
-{
-    QFile file;
-    file.setFileName(fileName);
-    if (!file.open(QFile::WriteOnly)) {
-        return false;
-    }
+// One entry is always kept for the transparent color.
+static const int MaxPaletteColors = 255;
 
-    QImage image = img;
+static inline int lookupKey(int r, int g, int b)
+{
+    return ((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3);
+}
 
+static QVector<QRgb> quantizeColors(const QImage &image)
+{
     int dim = image.width() * image.height();
     GifByteType *rBuffer = new GifByteType[dim];
     GifByteType *gBuffer = new GifByteType[dim];
@@ -63,35 +69,153 @@ bool exportGif(const QImage &img, const QString &fileName)
         }
     }
 
-    int ColorMapSize = 255;
-    ColorMapObject cmap;
-    cmap.ColorCount = ColorMapSize;
-    cmap.BitsPerPixel = 8;
-    cmap.Colors = new GifColorType[ColorMapSize];
+    int ColorMapSize = MaxPaletteColors;
+    GifColorType *colors = new GifColorType[ColorMapSize];
     GifByteType *outputBuffer = new GifByteType[dim];
     QuantizeBuffer(image.width(), image.height(), &ColorMapSize,
-                   rBuffer, gBuffer, bBuffer, outputBuffer, cmap.Colors);
+                   rBuffer, gBuffer, bBuffer, outputBuffer, colors);
 
     QVector<QRgb> colorTable;
     colorTable.reserve(256);
     for (int i = 0; i < ColorMapSize; ++i) {
-        GifColorType color = cmap.Colors[i];
+        GifColorType color = colors[i];
         colorTable += qRgb(color.Red, color.Green, color.Blue);
     }
-    colorTable += qRgba(0, 0, 0, 0);
-    while (colorTable.count() < 256)
-        colorTable += qRgb(0, 0, 0);
 
+    delete [] colors;
     delete [] outputBuffer;
     delete [] rBuffer;
     delete [] gBuffer;
     delete [] bBuffer;
 
-    image = image.convertToFormat(QImage::Format_Indexed8, colorTable);
+    return colorTable;
+}
+
+// Appends the transparent entry and pads the table to the 256 colors the
+// GIF screen descriptor is written with.
+static QVector<QRgb> gifColorTable(const QVector<QRgb> &colors)
+{
+    QVector<QRgb> colorTable = colors;
+    colorTable.reserve(256);
+    colorTable += qRgba(0, 0, 0, 0);
+    while (colorTable.count() < 256)
+        colorTable += qRgb(0, 0, 0);
+    return colorTable;
+}
+
+GifPalette::GifPalette()
+{
+}
+
+GifPalette GifPalette::webSafe()
+{
+    QVector<QRgb> colors;
+    colors.reserve(216);
+    for (int r = 0; r < 6; ++r)
+        for (int g = 0; g < 6; ++g)
+            for (int b = 0; b < 6; ++b)
+                colors += qRgb(r * 51, g * 51, b * 51);
+    return fromColors(colors);
+}
+
+GifPalette GifPalette::fromColors(const QVector<QRgb> &colors)
+{
+    GifPalette palette;
+    if (colors.isEmpty())
+        return palette;
+
+    palette.m_colors = colors.mid(0, MaxPaletteColors);
+
+    // Precompute the nearest palette entry for the center of every 15-bit
+    // RGB cell, so that mapping a pixel is a single table lookup.
+    palette.m_lookup.resize(32768);
+    const int count = palette.m_colors.count();
+    const QRgb *table = palette.m_colors.constData();
+    for (int key = 0; key < 32768; ++key) {
+        const int r = (((key >> 10) & 0x1f) << 3) | 4;
+        const int g = (((key >> 5) & 0x1f) << 3) | 4;
+        const int b = ((key & 0x1f) << 3) | 4;
+        int best = 0;
+        int bestDistance = INT_MAX;
+        for (int c = 0; c < count; ++c) {
+            const int dr = qRed(table[c]) - r;
+            const int dg = qGreen(table[c]) - g;
+            const int db = qBlue(table[c]) - b;
+            const int distance = dr * dr + dg * dg + db * db;
+            if (distance < bestDistance) {
+                bestDistance = distance;
+                best = c;
+            }
+        }
+        palette.m_lookup[key] = best;
+    }
+
+    return palette;
+}
+
+GifPalette GifPalette::fromImage(const QImage &image)
+{
+    if (image.isNull())
+        return GifPalette();
+    if (image.format() == QImage::Format_Indexed8) {
+        QVector<QRgb> colors;
+        foreach (QRgb color, image.colorTable()) {
+            if (qAlpha(color) != 0)
+                colors += color;
+        }
+        return fromColors(colors);
+    }
+    return fromColors(quantizeColors(image));
+}
+
+bool GifPalette::isNull() const
+{
+    return m_colors.isEmpty();
+}
+
+QVector<QRgb> GifPalette::colors() const
+{
+    return m_colors;
+}
+
+QImage GifPalette::map(const QImage &image) const
+{
+    const bool hasAlpha = image.format() != QImage::Format_RGB32;
+    const QImage source = (image.format() == QImage::Format_ARGB32 || !hasAlpha) ?
+                image : image.convertToFormat(QImage::Format_ARGB32);
+
+    const int transparent = m_colors.count();
+    const uchar *lookup = m_lookup.constData();
+
+    QImage result(source.size(), QImage::Format_Indexed8);
+    result.setColorTable(gifColorTable(m_colors));
+    for (int y = 0; y < source.height(); ++y) {
+        const QRgb *src = (const QRgb*)(source.scanLine(y));
+        uchar *dst = result.scanLine(y);
+        for (int x = 0; x < source.width(); ++x) {
+            const QRgb color = src[x];
+            if (hasAlpha && qAlpha(color) == 0)
+                dst[x] = transparent;
+            else
+                dst[x] = lookup[lookupKey(qRed(color), qGreen(color), qBlue(color))];
+        }
+    }
+    return result;
+}
+
+QByteArray encodeGif(const QImage &img, const GifPalette &palette)
+{
+    QImage image;
+    if (palette.isNull())
+        image = img.convertToFormat(QImage::Format_Indexed8, gifColorTable(quantizeColors(img)));
+    else
+        image = palette.map(img);
 
-    colorTable = image.colorTable();
+    QVector<QRgb> colorTable = image.colorTable();
+    ColorMapObject cmap;
     cmap.ColorCount = 256;
     cmap.BitsPerPixel = 8;
+    cmap.Colors = new GifColorType[256];
     int bgcolor = -1;
     for (int c = 0; c < 256; ++c) {
         cmap.Colors[c].Red = qRed(colorTable[c]);
@@ -102,7 +226,12 @@ bool exportGif(const QImage &img, const QString &fileName)
     }
     EGifSetGifVersion("87a");
 
-    GifFileType *gif = EGifOpen(&file, saveGifBlock);
+    // Screenshots usually compress well; start with room for a quarter of
+    // the indexed pixels and let the array grow from there.
+    QByteArray data;
+    data.reserve(image.width() * image.height() / 4 + 1024);
+
+    GifFileType *gif = EGifOpen(&data, saveGifBlock);
     gif->ImageCount = 1;
     EGifPutScreenDesc(gif, image.width(), image.height(), 256, 0, &cmap);
     if (bgcolor >= 0) {
@@ -111,16 +240,36 @@ bool exportGif(const QImage &img, const QString &fileName)
     }
     EGifPutImageDesc(gif, 0, 0, image.width(), image.height(), 0, &cmap);
 
+    bool ok = true;
     for (int y = 0; y < image.height(); ++y) {
         if (EGifPutLine(gif, (GifPixelType*)(image.scanLine(y)), img.width()) == GIF_ERROR) {
+            ok = false;
             break;
         }
     }
 
     EGifCloseFile(gif);
-    file.close();
 
     delete [] cmap.Colors;
 
-    return true;
+    if (!ok)
+        return QByteArray();
+    return data;
+}
+
+bool exportGif(const QImage &img, const QString &fileName, const GifPalette &palette)
+{
+    QFile file;
+    file.setFileName(fileName);
+    if (!file.open(QFile::WriteOnly)) {
+        return false;
+    }
+
+    QByteArray data = encodeGif(img, palette);
+    if (data.isEmpty())
+        return false;
+
+    bool ok = file.write(data) == data.size();
+    file.close();
+    return ok;
 }
@@ -30,9 +30,33 @@
 #ifndef GIFWRITER_H
 #define GIFWRITER_H
 
+#include <QByteArray>
 #include <QImage>
 #include <QString>
+#include <QVector>
 
-bool exportGif(const QImage &image, const QString &fileName);
+// A fixed color table shared across several GIF exports. Mapping a pixel goes
+// through a 15-bit RGB lookup table, so no histogram or median cut is needed.
+class GifPalette
+{
+public:
+    GifPalette();
+
+    static GifPalette webSafe();
+    static GifPalette fromColors(const QVector<QRgb> &colors);
+    static GifPalette fromImage(const QImage &image);
+
+    bool isNull() const;
+    QVector<QRgb> colors() const;
+
+    QImage map(const QImage &image) const;
+
+private:
+    QVector<QRgb> m_colors;
+    QVector<uchar> m_lookup;
+};
+
+QByteArray encodeGif(const QImage &image, const GifPalette &palette = GifPalette());
+bool exportGif(const QImage &image, const QString &fileName, const GifPalette &palette = GifPalette());
 
 #endif
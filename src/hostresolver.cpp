@@ -0,0 +1,216 @@
+/*
+  This file is part of the PhantomJS project from Ofi Labs.
+
+  Copyright (C) 2011 Ariya Hidayat <ariya.hidayat@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "hostresolver.h"
+#include "networkaccessmanager.h"
+
+#include <QNetworkCookie>
+#include <QNetworkCookieJar>
+#include <QStringList>
+
+HostResolver::HostResolver(QObject *parent)
+    : QObject(parent)
+    , m_cacheTtl(0)
+    , m_lookupCount(0)
+    , m_cacheHits(0)
+    , m_lookupTime(0)
+{
+}
+
+// A comma separated list of host=address pairs.
+bool HostResolver::setHostMap(const QString &text)
+{
+    QHash<QString, QHostAddress> hostMap;
+    foreach (const QString &item, text.split(',', QString::SkipEmptyParts)) {
+        const int separator = item.indexOf('=');
+        if (separator <= 0)
+            return false;
+        QHostAddress address;
+        if (!address.setAddress(item.mid(separator + 1).trimmed()))
+            return false;
+        hostMap.insert(item.left(separator).trimmed().toLower(), address);
+    }
+    m_hostMap = hostMap;
+    return true;
+}
+
+void HostResolver::setCacheTtl(int seconds)
+{
+    m_cacheTtl = qMax(seconds, 0);
+    if (!m_cacheTtl)
+        m_cache.clear();
+}
+
+// Addresses are left alone, and so is everything when neither the map nor
+// the cache is in use: Qt then resolves the host itself.
+//
+// So are HTTPS requests. Qt 4 takes the server name for TLS from the URL,
+// and an address there would get a virtual host's default certificate.
+// Below Qt 4.7, Qt's own cookie handling cannot be turned off for a
+// request, and would store the cookies under the address as well.
+bool HostResolver::handles(const QUrl &url) const
+{
+#if QT_VERSION < QT_VERSION_CHECK(4, 7, 0)
+    Q_UNUSED(url);
+    return false;
+#else
+    if (url.scheme().toLower() != "http")
+        return false;
+    const QString host = url.host().toLower();
+    if (host.isEmpty() || QHostAddress().setAddress(host))
+        return false;
+    return m_cacheTtl > 0 || m_hostMap.contains(host);
+#endif
+}
+
+void HostResolver::resolve(ResolvingReply *reply)
+{
+    const QString host = reply->url().host().toLower();
+    QHash<QString, QHostAddress>::const_iterator mapped = m_hostMap.constFind(host);
+    if (mapped != m_hostMap.constEnd()) {
+        reply->resolved(mapped.value());
+        return;
+    }
+
+    QHash<QString, CacheEntry>::iterator cached = m_cache.find(host);
+    if (cached != m_cache.end()) {
+        if (cached.value().expires > QDateTime::currentDateTime()) {
+            ++m_cacheHits;
+            reply->resolved(cached.value().address);
+            return;
+        }
+        m_cache.erase(cached);
+    }
+
+    QList<QPointer<ResolvingReply> > &waiting = m_waiting[host];
+    waiting += reply;
+    if (waiting.count() > 1)
+        return;
+
+    Lookup lookup;
+    lookup.host = host;
+    lookup.started.start();
+    m_lookups.insert(QHostInfo::lookupHost(host, this, SLOT(lookedUp(QHostInfo))), lookup);
+}
+
+// Lookups and their time since the last reset. Lookups that overlap are
+// each counted in full.
+QVariantMap HostResolver::stats() const
+{
+    QVariantMap result;
+    result["lookups"] = m_lookupCount;
+    result["cacheHits"] = m_cacheHits;
+    result["time"] = m_lookupTime;
+    return result;
+}
+
+void HostResolver::resetStats()
+{
+    m_lookupCount = 0;
+    m_cacheHits = 0;
+    m_lookupTime = 0;
+}
+
+void HostResolver::lookedUp(const QHostInfo &info)
+{
+    const Lookup lookup = m_lookups.take(info.lookupId());
+    ++m_lookupCount;
+    m_lookupTime += lookup.started.elapsed();
+
+    QHostAddress address;
+    if (info.error() == QHostInfo::NoError && !info.addresses().isEmpty())
+        address = info.addresses().first();
+
+    // QHostInfo does not report the record's own TTL, so the configured one
+    // applies to every host. Failures are not cached.
+    if (!address.isNull() && m_cacheTtl > 0) {
+        CacheEntry entry;
+        entry.address = address;
+        entry.expires = QDateTime::currentDateTime().addSecs(m_cacheTtl);
+        m_cache.insert(lookup.host, entry);
+    }
+
+    foreach (const QPointer<ResolvingReply> &reply, m_waiting.take(lookup.host)) {
+        if (reply)
+            reply->resolved(address);
+    }
+}
+
+ResolvingReply::ResolvingReply(NetworkAccessManager *manager, QNetworkAccessManager::Operation op,
+                               const QNetworkRequest &request, QIODevice *outgoingData, QObject *parent)
+    : ProxyReply(op, request, parent)
+    , m_manager(manager)
+    , m_outgoingData(outgoingData)
+{
+    m_manager->m_resolver.resolve(this);
+}
+
+void ResolvingReply::resolved(const QHostAddress &address)
+{
+    // Aborted while the lookup was running.
+    if (isDone())
+        return;
+
+    if (address.isNull()) {
+        fail(HostNotFoundError, QString("Host %1 not found").arg(url().host()));
+        return;
+    }
+
+    QNetworkRequest target = request();
+    QUrl targetUrl = url();
+    targetUrl.setHost(address.toString());
+    target.setUrl(targetUrl);
+
+    QByteArray host = QUrl::toAce(url().host());
+    if (url().port() != -1)
+        host += ':' + QByteArray::number(url().port());
+    target.setRawHeader("Host", host);
+
+    // The cookies belong to the name, not to the address.
+#if QT_VERSION >= QT_VERSION_CHECK(4, 7, 0)
+    target.setAttribute(QNetworkRequest::CookieLoadControlAttribute, QNetworkRequest::Manual);
+    target.setAttribute(QNetworkRequest::CookieSaveControlAttribute, QNetworkRequest::Manual);
+#endif
+    if (QNetworkCookieJar *jar = m_manager->cookieJar()) {
+        const QList<QNetworkCookie> cookies = jar->cookiesForUrl(url());
+        if (!cookies.isEmpty())
+            target.setHeader(QNetworkRequest::CookieHeader, qVariantFromValue(cookies));
+    }
+
+    attach(m_manager->createNetworkRequest(operation(), target, m_outgoingData));
+}
+
+void ResolvingReply::forwardMetaData()
+{
+    QNetworkCookieJar *jar = m_manager->cookieJar();
+    const QVariant cookies = innerReply()->header(QNetworkRequest::SetCookieHeader);
+    if (jar && cookies.isValid())
+        jar->setCookiesFromUrl(cookies.value<QList<QNetworkCookie> >(), url());
+    ProxyReply::forwardMetaData();
+}
@@ -0,0 +1,110 @@
+/*
+  This file is part of the PhantomJS project from Ofi Labs.
+
+  Copyright (C) 2011 Ariya Hidayat <ariya.hidayat@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef HOSTRESOLVER_H
+#define HOSTRESOLVER_H
+
+#include <QDateTime>
+#include <QHash>
+#include <QHostAddress>
+#include <QHostInfo>
+#include <QList>
+#include <QPointer>
+#include <QTime>
+#include <QVariantMap>
+
+#include "proxyreply.h"
+
+class NetworkAccessManager;
+class ResolvingReply;
+
+// Resolves host names for the page's requests: from the host map given on
+// the command line, from the cache while an earlier lookup is younger than
+// the TTL, or with an asynchronous lookup that requests for the same host
+// wait on together.
+class HostResolver: public QObject
+{
+    Q_OBJECT
+
+public:
+    HostResolver(QObject *parent = 0);
+
+    bool setHostMap(const QString &text);
+    void setCacheTtl(int seconds);
+
+    bool handles(const QUrl &url) const;
+    void resolve(ResolvingReply *reply);
+
+    QVariantMap stats() const;
+    void resetStats();
+
+private slots:
+    void lookedUp(const QHostInfo &info);
+
+private:
+    struct CacheEntry {
+        QHostAddress address;
+        QDateTime expires;
+    };
+    struct Lookup {
+        QString host;
+        QTime started;
+    };
+
+    QHash<QString, QHostAddress> m_hostMap;
+    int m_cacheTtl;
+    QHash<QString, CacheEntry> m_cache;
+    QHash<int, Lookup> m_lookups;
+    QHash<QString, QList<QPointer<ResolvingReply> > > m_waiting;
+    int m_lookupCount;
+    int m_cacheHits;
+    int m_lookupTime;
+};
+
+// A plain HTTP request sent to the resolved address instead of the host
+// name. The Host header and the cookies still use the name.
+class ResolvingReply: public ProxyReply
+{
+    Q_OBJECT
+
+public:
+    ResolvingReply(NetworkAccessManager *manager, QNetworkAccessManager::Operation op,
+                   const QNetworkRequest &request, QIODevice *outgoingData, QObject *parent = 0);
+
+    void resolved(const QHostAddress &address);
+
+protected slots:
+    void forwardMetaData();
+
+private:
+    NetworkAccessManager *m_manager;
+    QIODevice *m_outgoingData;
+};
+
+#endif // HOSTRESOLVER_H
@@ -0,0 +1,183 @@
+/*
+  This file is part of the PhantomJS project from Ofi Labs.
+
+  Copyright (C) 2011 Ariya Hidayat <ariya.hidayat@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "imagediff.h"
+
+#include <QVector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static const int TileSize = 16;
+
+// Compares one row. Differing pixels are set to 1 in the mask, if any, and
+// mark their tile.
+static int compareRow(const quint32 *a, const quint32 *b, int width, int threshold, uchar *mask, uchar *tiles)
+{
+    int count = 0;
+    int x = 0;
+
+#ifdef __SSE2__
+    // Four pixels at a time: the absolute difference of every channel,
+    // less the threshold, is only zero for channels close enough. A group
+    // never straddles two tiles, since the tile size is a multiple of four.
+    const __m128i limit = _mm_set1_epi8(char(threshold));
+    const __m128i zero = _mm_setzero_si128();
+    for (; x + 4 <= width; x += 4) {
+        const __m128i pa = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + x));
+        const __m128i pb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + x));
+        const __m128i delta = _mm_or_si128(_mm_subs_epu8(pa, pb), _mm_subs_epu8(pb, pa));
+        const __m128i over = _mm_subs_epu8(delta, limit);
+        const int same = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(over, zero)));
+        if (same == 0xf)
+            continue;
+        tiles[x / TileSize] = 1;
+        for (int i = 0; i < 4; ++i) {
+            if (!(same & (1 << i))) {
+                ++count;
+                if (mask)
+                    mask[x + i] = 1;
+            }
+        }
+    }
+#endif
+
+    for (; x < width; ++x) {
+        const quint32 pa = a[x];
+        const quint32 pb = b[x];
+        if (pa == pb)
+            continue;
+        bool differs = false;
+        for (int shift = 0; shift < 32 && !differs; shift += 8)
+            differs = qAbs(int((pa >> shift) & 0xff) - int((pb >> shift) & 0xff)) > threshold;
+        if (!differs)
+            continue;
+        ++count;
+        tiles[x / TileSize] = 1;
+        if (mask)
+            mask[x] = 1;
+    }
+    return count;
+}
+
+// Joins marked tiles into boxes, clipped to the compared area.
+static QList<QRect> tileBoxes(QVector<uchar> &tiles, int columns, int rows, const QRect &area)
+{
+    QList<QRect> boxes;
+    QVector<int> stack;
+    for (int start = 0; start < tiles.size(); ++start) {
+        if (!tiles[start])
+            continue;
+        tiles[start] = 0;
+        stack.append(start);
+        int left = columns, top = rows, right = -1, bottom = -1;
+        while (!stack.isEmpty()) {
+            const int tile = stack.last();
+            stack.pop_back();
+            const int tx = tile % columns;
+            const int ty = tile / columns;
+            left = qMin(left, tx);
+            right = qMax(right, tx);
+            top = qMin(top, ty);
+            bottom = qMax(bottom, ty);
+            for (int y = qMax(ty - 1, 0); y <= qMin(ty + 1, rows - 1); ++y) {
+                for (int x = qMax(tx - 1, 0); x <= qMin(tx + 1, columns - 1); ++x) {
+                    if (tiles[y * columns + x]) {
+                        tiles[y * columns + x] = 0;
+                        stack.append(y * columns + x);
+                    }
+                }
+            }
+        }
+        const QRect box(left * TileSize, top * TileSize,
+                        (right - left + 1) * TileSize, (bottom - top + 1) * TileSize);
+        boxes += box & area;
+    }
+    return boxes;
+}
+
+ImageDiff compareImages(const QImage &image, const QImage &baseline, int threshold, QImage *mask)
+{
+    ImageDiff diff;
+
+    // Both sides are compared in the format of the fresh image, which is
+    // only converted if it is not 32-bit already.
+    const QImage current = image.depth() == 32 ? image : image.convertToFormat(QImage::Format_ARGB32);
+    const QImage reference = baseline.format() == current.format() ? baseline : baseline.convertToFormat(current.format());
+
+    const int width = qMin(current.width(), reference.width());
+    const int height = qMin(current.height(), reference.height());
+    const QRect area(0, 0, width, height);
+    const QSize maskSize(qMax(current.width(), reference.width()), qMax(current.height(), reference.height()));
+
+    if (mask) {
+        *mask = QImage(maskSize, QImage::Format_Indexed8);
+        QVector<QRgb> colors;
+        colors << qRgba(0, 0, 0, 0) << qRgba(255, 0, 0, 255);
+        mask->setColorTable(colors);
+        mask->fill(0);
+    }
+
+    const int columns = (width + TileSize - 1) / TileSize;
+    const int rows = (height + TileSize - 1) / TileSize;
+    QVector<uchar> tiles(columns * rows, 0);
+    for (int y = 0; y < height; ++y) {
+        const quint32 *a = reinterpret_cast<const quint32*>(current.scanLine(y));
+        const quint32 *b = reinterpret_cast<const quint32*>(reference.scanLine(y));
+        uchar *maskLine = mask ? mask->scanLine(y) : 0;
+        diff.count += compareRow(a, b, width, threshold, maskLine, tiles.data() + (y / TileSize) * columns);
+    }
+    if (diff.count)
+        diff.boxes = tileBoxes(tiles, columns, rows, area);
+
+    // What lies outside the common area is different by definition.
+    diff.count += current.width() * current.height() - width * height;
+    diff.count += reference.width() * reference.height() - width * height;
+    QList<QRect> outside;
+    if (maskSize.width() > width)
+        outside += QRect(width, 0, maskSize.width() - width, maskSize.height());
+    if (maskSize.height() > height)
+        outside += QRect(0, height, width, maskSize.height() - height);
+    foreach (const QRect &rect, outside) {
+        diff.boxes += rect;
+        if (!mask)
+            continue;
+        for (int y = rect.top(); y <= rect.bottom(); ++y) {
+            uchar *maskLine = mask->scanLine(y);
+            for (int x = rect.left(); x <= rect.right(); ++x) {
+                const bool inCurrent = x < current.width() && y < current.height();
+                const bool inReference = x < reference.width() && y < reference.height();
+                if (inCurrent != inReference)
+                    maskLine[x] = 1;
+            }
+        }
+    }
+    return diff;
+}
@@ -0,0 +1,134 @@
+/*
+  This file is part of the PhantomJS project from Ofi Labs.
+
+  Copyright (C) 2011 Ariya Hidayat <ariya.hidayat@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "jsonwriter.h"
+
+#include <QDateTime>
+#include <QStringList>
+#include <QVariantList>
+#include <QVariantMap>
+
+#include <math.h>
+
+void appendJsonString(QByteArray &out, const QString &value)
+{
+    static const char hex[] = "0123456789abcdef";
+    const QByteArray utf8 = value.toUtf8();
+    out.reserve(out.size() + utf8.size() + 2);
+    out += '"';
+    for (int i = 0; i < utf8.size(); ++i) {
+        const unsigned char c = utf8.at(i);
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (c < 0x20) {
+                out += "\\u00";
+                out += hex[c >> 4];
+                out += hex[c & 0xf];
+            } else {
+                out += char(c);
+            }
+        }
+    }
+    out += '"';
+}
+
+void appendJson(QByteArray &out, const QVariant &value)
+{
+    switch (value.type()) {
+    case QVariant::Invalid:
+        out += "null";
+        break;
+    case QVariant::Bool:
+        out += value.toBool() ? "true" : "false";
+        break;
+    case QVariant::Int:
+    case QVariant::LongLong:
+        out += QByteArray::number(value.toLongLong());
+        break;
+    case QVariant::UInt:
+    case QVariant::ULongLong:
+        out += QByteArray::number(value.toULongLong());
+        break;
+    case QVariant::Double: {
+        const double number = value.toDouble();
+        // JSON has no representation for NaN and the infinities.
+        if (number != number || fabs(number) > 1.7976931348623157e308)
+            out += "null";
+        else if (number == floor(number) && fabs(number) < 1e15)
+            out += QByteArray::number(qint64(number));
+        else
+            out += QByteArray::number(number, 'g', 17);
+        break;
+    }
+    case QVariant::DateTime:
+        appendJsonString(out, value.toDateTime().toUTC().toString(Qt::ISODate) + "Z");
+        break;
+    case QVariant::List:
+    case QVariant::StringList: {
+        const QVariantList list = value.toList();
+        out += '[';
+        for (int i = 0; i < list.count(); ++i) {
+            if (i > 0)
+                out += ',';
+            appendJson(out, list.at(i));
+        }
+        out += ']';
+        break;
+    }
+    case QVariant::Map: {
+        const QVariantMap map = value.toMap();
+        out += '{';
+        bool first = true;
+        QVariantMap::const_iterator it;
+        for (it = map.constBegin(); it != map.constEnd(); ++it) {
+            if (!first)
+                out += ',';
+            first = false;
+            appendJsonString(out, it.key());
+            out += ':';
+            appendJson(out, it.value());
+        }
+        out += '}';
+        break;
+    }
+    default:
+        if (value.canConvert(QVariant::String))
+            appendJsonString(out, value.toString());
+        else
+            out += "null";
+        break;
+    }
+}
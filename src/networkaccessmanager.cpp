@@ -0,0 +1,230 @@
+/*
+  This file is part of the PhantomJS project from Ofi Labs.
+
+  Copyright (C) 2011 Ariya Hidayat <ariya.hidayat@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "networkaccessmanager.h"
+#include "networkarchive.h"
+#include "networkthrottle.h"
+
+#include <QNetworkCookie>
+#include <QNetworkCookieJar>
+#include <QNetworkReply>
+#include <QTimer>
+#include <QWebFrame>
+
+NetworkAccessManager::NetworkAccessManager(QObject *parent)
+    : QNetworkAccessManager(parent)
+    , m_resourceTimeout(0)
+    , m_recorder(0)
+    , m_replay(0)
+    , m_throttle(0)
+{
+}
+
+NetworkAccessManager::~NetworkAccessManager()
+{
+    // Closing the recording writes its index.
+    delete m_recorder;
+    delete m_replay;
+}
+
+bool NetworkAccessManager::setRecordFile(const QString &fileName)
+{
+    delete m_recorder;
+    m_recorder = new NetworkArchiveWriter;
+    if (m_recorder->open(fileName))
+        return true;
+    delete m_recorder;
+    m_recorder = 0;
+    return false;
+}
+
+bool NetworkAccessManager::setReplayFile(const QString &fileName)
+{
+    delete m_replay;
+    m_replay = new NetworkArchive;
+    if (m_replay->open(fileName))
+        return true;
+    delete m_replay;
+    m_replay = 0;
+    return false;
+}
+
+void NetworkAccessManager::setThrottle(const ThrottleProfile &profile)
+{
+    if (profile.isNull()) {
+        delete m_throttle;
+        m_throttle = 0;
+        return;
+    }
+    if (!m_throttle)
+        m_throttle = new NetworkThrottle(this);
+    m_throttle->setProfile(profile);
+}
+
+HostResolver *NetworkAccessManager::resolver()
+{
+    return &m_resolver;
+}
+
+const HostResolver *NetworkAccessManager::resolver() const
+{
+    return &m_resolver;
+}
+
+void NetworkAccessManager::setResourceTimeout(int ms)
+{
+    m_resourceTimeout = qMax(ms, 0);
+}
+
+int NetworkAccessManager::resourceTimeout() const
+{
+    return m_resourceTimeout;
+}
+
+void NetworkAccessManager::abortAll()
+{
+    // Aborting finishes the reply, which takes it out of the list.
+    foreach (QNetworkReply *reply, m_replies.keys())
+        reply->abort();
+}
+
+QNetworkReply *NetworkAccessManager::createRequest(Operation op, const QNetworkRequest &request, QIODevice *outgoingData)
+{
+    QNetworkReply *reply;
+    const QString scheme = request.url().scheme().toLower();
+    if (m_throttle && (scheme == "http" || scheme == "https"))
+        reply = new ThrottledReply(m_throttle, op, request, outgoingData, this);
+    else
+        reply = createBackendRequest(op, request, outgoingData);
+
+    // A reply is stalled when it has neither finished nor made any progress
+    // for the whole timeout, not when it merely takes long to download.
+    QTimer *timer = 0;
+    if (m_resourceTimeout > 0) {
+        timer = new QTimer(reply);
+        timer->setSingleShot(true);
+        timer->setInterval(m_resourceTimeout);
+        connect(timer, SIGNAL(timeout()), SLOT(replyStalled()));
+        connect(reply, SIGNAL(metaDataChanged()), SLOT(replyActivity()));
+        connect(reply, SIGNAL(downloadProgress(qint64, qint64)), SLOT(replyActivity()));
+        connect(reply, SIGNAL(uploadProgress(qint64, qint64)), SLOT(replyActivity()));
+        timer->start();
+    }
+    m_replies.insert(reply, timer);
+
+    // Only the top-level frame's responses are of interest; its
+    // subresources are reported too and told apart by URL later.
+#if QT_VERSION >= QT_VERSION_CHECK(4, 6, 0)
+    QWebFrame *frame = qobject_cast<QWebFrame*>(request.originatingObject());
+    if (frame && !frame->parentFrame())
+        connect(reply, SIGNAL(metaDataChanged()), SLOT(documentMetaData()));
+#endif
+
+    connect(reply, SIGNAL(metaDataChanged()), SLOT(replyMetaData()));
+    connect(reply, SIGNAL(finished()), SLOT(replyFinished()));
+    connect(reply, SIGNAL(destroyed(QObject*)), SLOT(replyDestroyed(QObject*)));
+    return reply;
+}
+
+// Replayed, or from the network and possibly recorded. Throttled replies call
+// this once the emulated network lets their request go out.
+QNetworkReply *NetworkAccessManager::createBackendRequest(Operation op, const QNetworkRequest &request, QIODevice *outgoingData)
+{
+    QNetworkReply *reply;
+    const QString scheme = request.url().scheme().toLower();
+    if (m_replay && (scheme == "http" || scheme == "https")) {
+        // Nothing goes to the network, so the cookies that would have been
+        // set by the response are stored here.
+        reply = m_replay->createReply(op, request, this);
+        if (cookieJar() && reply->hasRawHeader("Set-Cookie")) {
+            const QList<QNetworkCookie> cookies = reply->header(QNetworkRequest::SetCookieHeader).value<QList<QNetworkCookie> >();
+            cookieJar()->setCookiesFromUrl(cookies, request.url());
+        }
+    } else {
+        if (m_resolver.handles(request.url()))
+            reply = new ResolvingReply(this, op, request, outgoingData, this);
+        else
+            reply = createNetworkRequest(op, request, outgoingData);
+        if (m_recorder)
+            reply = new RecordingReply(reply, m_recorder, this);
+    }
+    return reply;
+}
+
+QNetworkReply *NetworkAccessManager::createNetworkRequest(Operation op, const QNetworkRequest &request, QIODevice *outgoingData)
+{
+    return QNetworkAccessManager::createRequest(op, request, outgoingData);
+}
+
+void NetworkAccessManager::documentMetaData()
+{
+    QNetworkReply *reply = static_cast<QNetworkReply*>(sender());
+    emit documentReceived(reply->url(), reply->rawHeader("ETag"), reply->rawHeader("Last-Modified"));
+}
+
+// WebKit follows a redirect with a new request for the target, which the
+// page needs to know to keep track of its document.
+void NetworkAccessManager::replyMetaData()
+{
+    QNetworkReply *reply = static_cast<QNetworkReply*>(sender());
+    const QUrl target = reply->attribute(QNetworkRequest::RedirectionTargetAttribute).toUrl();
+    if (target.isValid())
+        emit redirected(reply->url(), reply->url().resolved(target));
+}
+
+void NetworkAccessManager::replyActivity()
+{
+    QTimer *timer = m_replies.value(static_cast<QNetworkReply*>(sender()));
+    if (timer)
+        timer->start();
+}
+
+void NetworkAccessManager::replyStalled()
+{
+    QNetworkReply *reply = static_cast<QNetworkReply*>(sender()->parent());
+    if (!m_replies.contains(reply))
+        return;
+    emit resourceTimedOut(reply->url());
+    reply->abort();
+}
+
+void NetworkAccessManager::replyFinished()
+{
+    QNetworkReply *reply = static_cast<QNetworkReply*>(sender());
+    QTimer *timer = m_replies.take(reply);
+    if (timer)
+        timer->stop();
+}
+
+// Replies are normally finished before they are deleted, but WebKit may
+// delete a cancelled one right away.
+void NetworkAccessManager::replyDestroyed(QObject *reply)
+{
+    m_replies.remove(static_cast<QNetworkReply*>(reply));
+}
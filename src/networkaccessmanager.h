@@ -0,0 +1,97 @@
+/*
+  This file is part of the PhantomJS project from Ofi Labs.
+
+  Copyright (C) 2011 Ariya Hidayat <ariya.hidayat@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef NETWORKACCESSMANAGER_H
+#define NETWORKACCESSMANAGER_H
+
+#include <QHash>
+#include <QNetworkAccessManager>
+
+#include "hostresolver.h"
+
+class NetworkArchive;
+class NetworkArchiveWriter;
+class NetworkThrottle;
+struct ThrottleProfile;
+class QNetworkReply;
+class QTimer;
+
+// The network access manager of the page. It keeps track of the replies in
+// flight so that stalled ones can be aborted.
+class NetworkAccessManager: public QNetworkAccessManager
+{
+    Q_OBJECT
+
+public:
+    NetworkAccessManager(QObject *parent = 0);
+    ~NetworkAccessManager();
+
+    bool setRecordFile(const QString &fileName);
+    bool setReplayFile(const QString &fileName);
+    void setThrottle(const ThrottleProfile &profile);
+    HostResolver *resolver();
+    const HostResolver *resolver() const;
+
+    void setResourceTimeout(int ms);
+    int resourceTimeout() const;
+
+    void abortAll();
+
+signals:
+    void resourceTimedOut(const QUrl &url);
+    void redirected(const QUrl &url, const QUrl &target);
+    void documentReceived(const QUrl &url, const QByteArray &etag, const QByteArray &lastModified);
+
+protected:
+    QNetworkReply *createRequest(Operation op, const QNetworkRequest &request, QIODevice *outgoingData = 0);
+
+private slots:
+    void documentMetaData();
+    void replyMetaData();
+    void replyActivity();
+    void replyStalled();
+    void replyFinished();
+    void replyDestroyed(QObject *reply);
+
+private:
+    QNetworkReply *createBackendRequest(Operation op, const QNetworkRequest &request, QIODevice *outgoingData);
+    QNetworkReply *createNetworkRequest(Operation op, const QNetworkRequest &request, QIODevice *outgoingData);
+
+    int m_resourceTimeout;
+    NetworkArchiveWriter *m_recorder;
+    NetworkArchive *m_replay;
+    NetworkThrottle *m_throttle;
+    HostResolver m_resolver;
+    QHash<QNetworkReply*, QTimer*> m_replies;
+
+    friend class NetworkThrottle;
+    friend class ResolvingReply;
+};
+
+#endif // NETWORKACCESSMANAGER_H
@@ -0,0 +1,416 @@
+/*
+  This file is part of the PhantomJS project from Ofi Labs.
+
+  Copyright (C) 2011 Ariya Hidayat <ariya.hidayat@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "networkarchive.h"
+
+#include <QDataStream>
+#include <QTimer>
+#include <QtAlgorithms>
+#include <QtEndian>
+
+#include <stdio.h>
+#include <string.h>
+
+// Header: magic, version, entry count and the offset of the index. The
+// index holds one fixed size record per entry: key hash, entry offset and
+// entry length, all big endian like the rest of the file.
+static const quint32 ArchiveMagic = 0x504a5341; // "PJSA"
+static const quint32 ArchiveVersion = 1;
+static const int HeaderSize = 20;
+static const int IndexRecordSize = 20;
+
+// FNV-1a, so that the index does not depend on qHash() staying the same.
+static quint64 keyHash(const QByteArray &key)
+{
+    quint64 hash = Q_UINT64_C(14695981039346656037);
+    for (int i = 0; i < key.size(); ++i) {
+        hash ^= uchar(key.at(i));
+        hash *= Q_UINT64_C(1099511628211);
+    }
+    return hash;
+}
+
+static QByteArray archiveKey(QNetworkAccessManager::Operation op, const QNetworkRequest &request)
+{
+    QByteArray verb;
+    switch (op) {
+    case QNetworkAccessManager::HeadOperation: verb = "HEAD"; break;
+    case QNetworkAccessManager::GetOperation: verb = "GET"; break;
+    case QNetworkAccessManager::PutOperation: verb = "PUT"; break;
+    case QNetworkAccessManager::PostOperation: verb = "POST"; break;
+    case QNetworkAccessManager::DeleteOperation: verb = "DELETE"; break;
+    default:
+#if QT_VERSION >= QT_VERSION_CHECK(4, 7, 0)
+        verb = request.attribute(QNetworkRequest::CustomVerbAttribute).toByteArray();
+#endif
+        break;
+    }
+    return verb + ' ' + request.url().toEncoded(QUrl::RemoveFragment);
+}
+
+static bool isArchivable(const QUrl &url)
+{
+    const QString scheme = url.scheme().toLower();
+    return scheme == "http" || scheme == "https";
+}
+
+// Hash, then offset and length of the entry.
+typedef QPair<quint64, QPair<quint64, quint32> > IndexRecord;
+
+static bool lessHash(const IndexRecord &a, const IndexRecord &b)
+{
+    return a.first < b.first;
+}
+
+NetworkArchiveWriter::NetworkArchiveWriter()
+{
+}
+
+NetworkArchiveWriter::~NetworkArchiveWriter()
+{
+    close();
+}
+
+bool NetworkArchiveWriter::open(const QString &fileName)
+{
+    m_fileName = fileName;
+    m_file.setFileName(fileName + ".tmp");
+    if (!m_file.open(QFile::WriteOnly | QFile::Truncate))
+        return false;
+    m_index.clear();
+    return m_file.write(QByteArray(HeaderSize, '\0')) == HeaderSize;
+}
+
+void NetworkArchiveWriter::add(const QByteArray &key, int status, const QByteArray &reason,
+                               const RawHeaderList &headers, const QByteArray &body)
+{
+    if (!m_file.isOpen())
+        return;
+
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out << key << qint32(status) << reason << quint32(headers.count());
+    for (int i = 0; i < headers.count(); ++i)
+        out << headers.at(i).first << headers.at(i).second;
+    out << body;
+
+    // A resource loaded more than once keeps its last response; the earlier
+    // bytes stay in the file but are no longer indexed.
+    IndexEntry entry;
+    entry.hash = keyHash(key);
+    entry.offset = m_file.pos();
+    entry.length = data.size();
+    if (m_file.write(data) == data.size())
+        m_index.insert(key, entry);
+}
+
+bool NetworkArchiveWriter::close()
+{
+    if (!m_file.isOpen())
+        return false;
+
+    QList<IndexRecord> records;
+    foreach (const IndexEntry &entry, m_index)
+        records += qMakePair(entry.hash, qMakePair(entry.offset, entry.length));
+    qSort(records.begin(), records.end(), lessHash);
+
+    const quint64 indexOffset = m_file.pos();
+    QByteArray index;
+    QDataStream out(&index, QIODevice::WriteOnly);
+    for (int i = 0; i < records.count(); ++i)
+        out << records.at(i).first << records.at(i).second.first << records.at(i).second.second;
+
+    QByteArray header;
+    QDataStream headerOut(&header, QIODevice::WriteOnly);
+    headerOut << ArchiveMagic << ArchiveVersion << quint32(records.count()) << indexOffset;
+
+    bool ok = m_file.write(index) == index.size();
+    ok = ok && m_file.seek(0) && m_file.write(header) == header.size();
+    m_file.close();
+    m_index.clear();
+
+    const QString tempName = m_file.fileName();
+    if (!ok) {
+        QFile::remove(tempName);
+        return false;
+    }
+#ifdef Q_OS_UNIX
+    return ::rename(QFile::encodeName(tempName).constData(), QFile::encodeName(m_fileName).constData()) == 0;
+#else
+    QFile::remove(m_fileName);
+    return QFile::rename(tempName, m_fileName);
+#endif
+}
+
+NetworkArchive::NetworkArchive()
+    : m_data(0)
+    , m_size(0)
+    , m_index(0)
+    , m_count(0)
+{
+}
+
+NetworkArchive::~NetworkArchive()
+{
+    if (m_data)
+        m_file.unmap(const_cast<uchar*>(m_data));
+}
+
+bool NetworkArchive::open(const QString &fileName)
+{
+    m_file.setFileName(fileName);
+    if (!m_file.open(QFile::ReadOnly))
+        return false;
+    m_size = m_file.size();
+    if (m_size < HeaderSize)
+        return false;
+    m_data = m_file.map(0, m_size);
+    if (!m_data)
+        return false;
+
+    const quint32 magic = qFromBigEndian<quint32>(m_data);
+    const quint32 version = qFromBigEndian<quint32>(m_data + 4);
+    const quint32 count = qFromBigEndian<quint32>(m_data + 8);
+    const quint64 indexOffset = qFromBigEndian<quint64>(m_data + 12);
+    if (magic != ArchiveMagic || version != ArchiveVersion)
+        return false;
+    if (indexOffset > quint64(m_size) || quint64(count) * IndexRecordSize > quint64(m_size) - indexOffset)
+        return false;
+
+    m_index = m_data + indexOffset;
+    m_count = count;
+    return true;
+}
+
+int NetworkArchive::count() const
+{
+    return m_count;
+}
+
+bool NetworkArchive::find(const QByteArray &key, int *status, QByteArray *reason,
+                          RawHeaderList *headers, QByteArray *body) const
+{
+    const quint64 hash = keyHash(key);
+
+    // Lower bound of the hash, then every record sharing it.
+    quint32 low = 0;
+    quint32 high = m_count;
+    while (low < high) {
+        const quint32 middle = low + (high - low) / 2;
+        if (qFromBigEndian<quint64>(m_index + middle * IndexRecordSize) < hash)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    for (quint32 i = low; i < m_count; ++i) {
+        const uchar *record = m_index + i * IndexRecordSize;
+        if (qFromBigEndian<quint64>(record) != hash)
+            break;
+        const quint64 offset = qFromBigEndian<quint64>(record + 8);
+        const quint32 length = qFromBigEndian<quint32>(record + 16);
+        if (offset + length > quint64(m_size))
+            continue;
+
+        const QByteArray entry = QByteArray::fromRawData(reinterpret_cast<const char*>(m_data + offset), length);
+        QDataStream in(entry);
+        QByteArray entryKey;
+        in >> entryKey;
+        if (entryKey != key)
+            continue;
+
+        qint32 entryStatus;
+        quint32 headerCount;
+        in >> entryStatus >> *reason >> headerCount;
+        headers->clear();
+        for (quint32 h = 0; h < headerCount && in.status() == QDataStream::Ok; ++h) {
+            QByteArray name;
+            QByteArray value;
+            in >> name >> value;
+            headers->append(qMakePair(name, value));
+        }
+
+        // The body is not copied: it points into the mapping.
+        quint32 bodySize;
+        in >> bodySize;
+        if (bodySize == 0xffffffff)
+            bodySize = 0;
+        const qint64 bodyOffset = in.device()->pos();
+        if (in.status() != QDataStream::Ok || bodyOffset + bodySize > length)
+            return false;
+        *body = QByteArray::fromRawData(entry.constData() + bodyOffset, bodySize);
+        *status = entryStatus;
+        return true;
+    }
+    return false;
+}
+
+QNetworkReply *NetworkArchive::createReply(QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent) const
+{
+    ArchiveReply *reply = new ArchiveReply(op, request, parent);
+    int status;
+    QByteArray reason;
+    RawHeaderList headers;
+    QByteArray body;
+    if (find(archiveKey(op, request), &status, &reason, &headers, &body))
+        reply->setResponse(status, reason, headers, body);
+    return reply;
+}
+
+RecordingReply::RecordingReply(QNetworkReply *reply, NetworkArchiveWriter *writer, QObject *parent)
+    : ProxyReply(reply->operation(), reply->request(), parent)
+    , m_writer(writer)
+    , m_recorded(!isArchivable(reply->url()))
+{
+    attach(reply);
+}
+
+void RecordingReply::abort()
+{
+    m_recorded = true;
+    ProxyReply::abort();
+}
+
+qint64 RecordingReply::readData(char *data, qint64 maxSize)
+{
+    const qint64 size = ProxyReply::readData(data, maxSize);
+    if (size > 0 && !m_recorded)
+        m_body.append(data, size);
+    return size;
+}
+
+void RecordingReply::forwardFinished()
+{
+    // HTTP errors such as a 404 are recorded as well; only replies that got
+    // no response at all are left out.
+    QNetworkReply *reply = innerReply();
+    const QVariant status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
+    if (!m_recorded && status.isValid()) {
+        // Whatever the page has not read yet is still in the inner reply.
+        const QByteArray body = m_body + reply->peek(reply->bytesAvailable());
+
+        // The body is stored decoded, so the headers describing the
+        // transfer are rewritten to match it.
+        RawHeaderList headers;
+        foreach (const QByteArray &name, reply->rawHeaderList()) {
+            const QByteArray lower = name.toLower();
+            if (lower == "content-encoding" || lower == "transfer-encoding" || lower == "content-length")
+                continue;
+            headers.append(qMakePair(name, reply->rawHeader(name)));
+        }
+        headers.append(qMakePair(QByteArray("Content-Length"), QByteArray::number(body.size())));
+
+        m_writer->add(archiveKey(operation(), request()),
+                      status.toInt(),
+                      reply->attribute(QNetworkRequest::HttpReasonPhraseAttribute).toByteArray(),
+                      headers, body);
+        m_recorded = true;
+        m_body.clear();
+    }
+
+    ProxyReply::forwardFinished();
+}
+
+ArchiveReply::ArchiveReply(QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent)
+    : QNetworkReply(parent)
+    , m_offset(0)
+    , m_found(false)
+    , m_aborted(false)
+{
+    setRequest(request);
+    setOperation(op);
+    setUrl(request.url());
+    open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+
+    // Signals are only emitted once the page had a chance to connect.
+    QTimer::singleShot(0, this, SLOT(deliver()));
+}
+
+void ArchiveReply::setResponse(int status, const QByteArray &reason, const RawHeaderList &headers, const QByteArray &body)
+{
+    m_found = true;
+    m_body = body;
+    for (int i = 0; i < headers.count(); ++i)
+        setRawHeader(headers.at(i).first, headers.at(i).second);
+    setAttribute(QNetworkRequest::HttpStatusCodeAttribute, status);
+    setAttribute(QNetworkRequest::HttpReasonPhraseAttribute, reason);
+    if (status >= 300 && status < 400 && hasRawHeader("Location"))
+        setAttribute(QNetworkRequest::RedirectionTargetAttribute, QUrl::fromEncoded(rawHeader("Location")));
+}
+
+void ArchiveReply::abort()
+{
+    if (m_aborted)
+        return;
+    m_aborted = true;
+    m_offset = m_body.size();
+    setError(OperationCanceledError, "Operation canceled");
+}
+
+qint64 ArchiveReply::bytesAvailable() const
+{
+    return m_body.size() - m_offset + QNetworkReply::bytesAvailable();
+}
+
+bool ArchiveReply::isSequential() const
+{
+    return true;
+}
+
+qint64 ArchiveReply::readData(char *data, qint64 maxSize)
+{
+    const qint64 size = qMin(maxSize, qint64(m_body.size()) - m_offset);
+    if (size <= 0)
+        return -1;
+    memcpy(data, m_body.constData() + m_offset, size);
+    m_offset += size;
+    return size;
+}
+
+void ArchiveReply::deliver()
+{
+    if (m_aborted) {
+        emit error(OperationCanceledError);
+    } else if (!m_found) {
+        setError(ContentNotFoundError, "Not in the replay archive: " + url().toString());
+        emit error(ContentNotFoundError);
+    } else {
+        emit metaDataChanged();
+        if (!m_body.isEmpty()) {
+            emit downloadProgress(m_body.size(), m_body.size());
+            emit readyRead();
+        }
+    }
+
+#if QT_VERSION >= QT_VERSION_CHECK(4, 7, 0)
+    setFinished(true);
+#endif
+    emit readChannelFinished();
+    emit finished();
+}
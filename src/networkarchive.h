@@ -0,0 +1,146 @@
+/*
+  This file is part of the PhantomJS project from Ofi Labs.
+
+  Copyright (C) 2011 Ariya Hidayat <ariya.hidayat@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef NETWORKARCHIVE_H
+#define NETWORKARCHIVE_H
+
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QPair>
+
+#include "proxyreply.h"
+
+typedef QList<QPair<QByteArray, QByteArray> > RawHeaderList;
+
+// Writes the responses served to the page into an archive file: a header,
+// the entries in the order they were received and, once the archive is
+// closed, an index sorted by key hash. Until then the file is only written
+// aside, so an interrupted recording never leaves a broken archive behind.
+class NetworkArchiveWriter
+{
+public:
+    NetworkArchiveWriter();
+    ~NetworkArchiveWriter();
+
+    bool open(const QString &fileName);
+    bool close();
+
+    void add(const QByteArray &key, int status, const QByteArray &reason,
+             const RawHeaderList &headers, const QByteArray &body);
+
+private:
+    struct IndexEntry {
+        quint64 hash;
+        quint64 offset;
+        quint32 length;
+    };
+
+    QString m_fileName;
+    QFile m_file;
+    QHash<QByteArray, IndexEntry> m_index;
+};
+
+// A recorded archive, memory mapped. Lookups are a binary search over the
+// mapped index and the bodies are served straight from the mapping.
+class NetworkArchive
+{
+public:
+    NetworkArchive();
+    ~NetworkArchive();
+
+    bool open(const QString &fileName);
+    int count() const;
+
+    QNetworkReply *createReply(QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent) const;
+
+private:
+    bool find(const QByteArray &key, int *status, QByteArray *reason,
+              RawHeaderList *headers, QByteArray *body) const;
+
+    QFile m_file;
+    const uchar *m_data;
+    qint64 m_size;
+    const uchar *m_index;
+    quint32 m_count;
+};
+
+// Passes a reply through to the page unchanged, keeping a copy of what was
+// read for the archive.
+class RecordingReply: public ProxyReply
+{
+    Q_OBJECT
+
+public:
+    RecordingReply(QNetworkReply *reply, NetworkArchiveWriter *writer, QObject *parent = 0);
+
+    void abort();
+
+protected:
+    qint64 readData(char *data, qint64 maxSize);
+
+protected slots:
+    void forwardFinished();
+
+private:
+    NetworkArchiveWriter *m_writer;
+    QByteArray m_body;
+    bool m_recorded;
+};
+
+// A reply served from an archive, or a 404 for anything not in it.
+class ArchiveReply: public QNetworkReply
+{
+    Q_OBJECT
+
+public:
+    ArchiveReply(QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent = 0);
+
+    void setResponse(int status, const QByteArray &reason, const RawHeaderList &headers, const QByteArray &body);
+
+    void abort();
+    qint64 bytesAvailable() const;
+    bool isSequential() const;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize);
+
+private slots:
+    void deliver();
+
+private:
+    QByteArray m_body;
+    qint64 m_offset;
+    bool m_found;
+    bool m_aborted;
+};
+
+#endif // NETWORKARCHIVE_H
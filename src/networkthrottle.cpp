@@ -0,0 +1,360 @@
+/*
+  This file is part of the PhantomJS project from Ofi Labs.
+
+  Copyright (C) 2011 Ariya Hidayat <ariya.hidayat@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "networkthrottle.h"
+#include "networkaccessmanager.h"
+
+#include <QStringList>
+
+#include <string.h>
+
+// How often the download rate is handed out, and how much unused rate may
+// be saved up for a burst.
+static const int PumpInterval = 10;
+static const int MaxBurstMs = 50;
+
+// Browsers open at most six connections per host.
+static const int DefaultConnectionsPerHost = 6;
+
+static const struct {
+    const char *name;
+    int latency;    // ms
+    int download;   // kbit/s
+    int upload;     // kbit/s
+} throttlePresets[] = {
+    { "gprs", 500, 50, 20 },
+    { "2g", 300, 250, 50 },
+    { "3g", 100, 750, 250 },
+    { "4g", 20, 4000, 3000 },
+    { "dsl", 5, 2000, 1000 },
+    { "wifi", 2, 30000, 15000 }
+};
+
+static inline int kbitToBytes(int kbit)
+{
+    return kbit * 1000 / 8;
+}
+
+ThrottleProfile::ThrottleProfile()
+    : latency(0)
+    , downloadRate(0)
+    , uploadRate(0)
+    , maxConnectionsPerHost(0)
+{
+}
+
+// Either a preset name or latency=MS,down=KBIT,up=KBIT,connections=N, or a
+// preset followed by any of those, e.g. "3g,connections=2".
+bool ThrottleProfile::parse(const QString &text, ThrottleProfile *profile)
+{
+    ThrottleProfile result;
+    result.maxConnectionsPerHost = DefaultConnectionsPerHost;
+
+    foreach (const QString &item, text.split(',', QString::SkipEmptyParts)) {
+        const int separator = item.indexOf('=');
+        if (separator < 0) {
+            bool found = false;
+            for (uint i = 0; i < sizeof(throttlePresets) / sizeof(throttlePresets[0]); ++i) {
+                if (item.trimmed().toLower() == throttlePresets[i].name) {
+                    result.latency = throttlePresets[i].latency;
+                    result.downloadRate = kbitToBytes(throttlePresets[i].download);
+                    result.uploadRate = kbitToBytes(throttlePresets[i].upload);
+                    found = true;
+                }
+            }
+            if (!found)
+                return false;
+            continue;
+        }
+
+        const QString key = item.left(separator).trimmed();
+        bool ok;
+        const int value = item.mid(separator + 1).toInt(&ok);
+        if (!ok || value < 0)
+            return false;
+        if (key == "latency")
+            result.latency = value;
+        else if (key == "down")
+            result.downloadRate = kbitToBytes(value);
+        else if (key == "up")
+            result.uploadRate = kbitToBytes(value);
+        else if (key == "connections")
+            result.maxConnectionsPerHost = value;
+        else
+            return false;
+    }
+
+    *profile = result;
+    return true;
+}
+
+bool ThrottleProfile::isNull() const
+{
+    return !latency && !downloadRate && !uploadRate && !maxConnectionsPerHost;
+}
+
+NetworkThrottle::NetworkThrottle(NetworkAccessManager *manager)
+    : QObject(manager)
+    , m_manager(manager)
+    , m_credit(0)
+{
+    m_pumpTimer.setInterval(PumpInterval);
+    connect(&m_pumpTimer, SIGNAL(timeout()), SLOT(pump()));
+}
+
+void NetworkThrottle::setProfile(const ThrottleProfile &profile)
+{
+    m_profile = profile;
+}
+
+ThrottleProfile NetworkThrottle::profile() const
+{
+    return m_profile;
+}
+
+void NetworkThrottle::enqueue(ThrottledReply *reply)
+{
+    const QString host = reply->hostKey();
+    if (m_profile.maxConnectionsPerHost > 0 && m_connections.value(host) >= m_profile.maxConnectionsPerHost) {
+        m_waiting[host] += reply;
+        return;
+    }
+    connectReply(reply);
+}
+
+void NetworkThrottle::connectReply(ThrottledReply *reply)
+{
+    ++m_connections[reply->hostKey()];
+    m_active += reply;
+
+    int delay = m_profile.latency;
+    if (m_profile.uploadRate > 0)
+        delay += int(reply->uploadSize() * 1000 / m_profile.uploadRate);
+    QTimer::singleShot(delay, reply, SLOT(send()));
+}
+
+void NetworkThrottle::send(ThrottledReply *reply)
+{
+    reply->attach(m_manager->createBackendRequest(reply->operation(), reply->request(), reply->outgoingData()));
+}
+
+// The connection stays taken until the page has received the whole reply,
+// not just until the server is done sending it.
+void NetworkThrottle::release(ThrottledReply *reply)
+{
+    const QString host = reply->hostKey();
+    if (!m_active.removeOne(reply)) {
+        QHash<QString, QList<ThrottledReply*> >::iterator waiting = m_waiting.find(host);
+        if (waiting != m_waiting.end()) {
+            waiting.value().removeOne(reply);
+            if (waiting.value().isEmpty())
+                m_waiting.erase(waiting);
+        }
+        return;
+    }
+
+    if (--m_connections[host] <= 0)
+        m_connections.remove(host);
+
+    QHash<QString, QList<ThrottledReply*> >::iterator waiting = m_waiting.find(host);
+    if (waiting != m_waiting.end()) {
+        ThrottledReply *next = waiting.value().takeFirst();
+        if (waiting.value().isEmpty())
+            m_waiting.erase(waiting);
+        connectReply(next);
+    }
+}
+
+void NetworkThrottle::wake()
+{
+    if (m_pumpTimer.isActive())
+        return;
+    m_lastPump.start();
+    m_pumpTimer.start();
+}
+
+void NetworkThrottle::pump()
+{
+    const int elapsed = m_lastPump.restart();
+    const qint64 maxCredit = qint64(m_profile.downloadRate) * MaxBurstMs / 1000;
+    m_credit = qMin(m_credit + qint64(m_profile.downloadRate) * elapsed / 1000, qMax(maxCredit, qint64(1)));
+
+    // Passing data on may finish a reply, and the page may delete it.
+    QList<QPointer<ThrottledReply> > receiving;
+    foreach (ThrottledReply *reply, m_active) {
+        if (reply->pendingBytes() > 0)
+            receiving += reply;
+    }
+    if (receiving.isEmpty()) {
+        m_pumpTimer.stop();
+        m_credit = 0;
+        return;
+    }
+
+    const qint64 share = m_credit / receiving.count();
+    if (share <= 0)
+        return;
+    foreach (const QPointer<ThrottledReply> &reply, receiving) {
+        if (!reply)
+            continue;
+        const qint64 size = qMin(share, reply->pendingBytes());
+        reply->pass(size);
+        m_credit -= size;
+    }
+}
+
+ThrottledReply::ThrottledReply(NetworkThrottle *throttle, QNetworkAccessManager::Operation op,
+                               const QNetworkRequest &request, QIODevice *outgoingData, QObject *parent)
+    : ProxyReply(op, request, parent)
+    , m_throttle(throttle)
+    , m_outgoingData(outgoingData)
+    , m_passed(0)
+    , m_replyFinished(false)
+{
+    m_throttle->enqueue(this);
+}
+
+// The throttle may already be gone when the manager deletes its children.
+ThrottledReply::~ThrottledReply()
+{
+    if (!isDone() && m_throttle)
+        m_throttle->release(this);
+}
+
+// Ends the reply right away, without the data still held back.
+void ThrottledReply::abort()
+{
+    if (isDone())
+        return;
+    if (innerReply()) {
+        disconnect(innerReply(), 0, this, 0);
+        innerReply()->abort();
+    }
+    m_buffer.clear();
+    if (m_throttle)
+        m_throttle->release(this);
+    fail(OperationCanceledError, "Operation canceled");
+}
+
+qint64 ThrottledReply::bytesAvailable() const
+{
+    return m_buffer.size() + QNetworkReply::bytesAvailable();
+}
+
+QString ThrottledReply::hostKey() const
+{
+    const QUrl &requestUrl = request().url();
+    const int defaultPort = requestUrl.scheme().toLower() == "https" ? 443 : 80;
+    return requestUrl.host().toLower() + ':' + QString::number(requestUrl.port(defaultPort));
+}
+
+QIODevice *ThrottledReply::outgoingData() const
+{
+    return m_outgoingData;
+}
+
+qint64 ThrottledReply::uploadSize() const
+{
+    if (!m_outgoingData || m_outgoingData->isSequential())
+        return 0;
+    return m_outgoingData->size();
+}
+
+qint64 ThrottledReply::pendingBytes() const
+{
+    return innerReply() && !isDone() ? innerReply()->bytesAvailable() : 0;
+}
+
+void ThrottledReply::pass(qint64 maxSize)
+{
+    const QByteArray data = innerReply()->read(maxSize);
+    if (!data.isEmpty()) {
+        m_buffer += data;
+        m_passed += data.size();
+        const QVariant total = innerReply()->header(QNetworkRequest::ContentLengthHeader);
+        emit downloadProgress(m_passed, total.isValid() ? total.toLongLong() : -1);
+        emit readyRead();
+    }
+    finishIfDone();
+}
+
+qint64 ThrottledReply::readData(char *data, qint64 maxSize)
+{
+    const qint64 size = qMin(maxSize, qint64(m_buffer.size()));
+    if (size <= 0)
+        return isDone() ? -1 : 0;
+    memcpy(data, m_buffer.constData(), size);
+    m_buffer.remove(0, size);
+    return size;
+}
+
+void ThrottledReply::send()
+{
+    if (!isDone() && m_throttle)
+        m_throttle->send(this);
+}
+
+void ThrottledReply::forwardReadyRead()
+{
+    if (m_throttle && m_throttle->profile().downloadRate > 0)
+        m_throttle->wake();
+    else
+        pass(pendingBytes());
+}
+
+// The progress is reported for what was passed on, in pass().
+void ThrottledReply::forwardDownloadProgress(qint64 received, qint64 total)
+{
+    Q_UNUSED(received);
+    Q_UNUSED(total);
+}
+
+// Reported with finished(), after the data that arrived before the error.
+void ThrottledReply::forwardError(QNetworkReply::NetworkError code)
+{
+    setError(code, innerReply()->errorString());
+}
+
+void ThrottledReply::forwardFinished()
+{
+    m_replyFinished = true;
+    forwardReadyRead();
+    finishIfDone();
+}
+
+void ThrottledReply::finishIfDone()
+{
+    if (isDone() || !m_replyFinished || pendingBytes() > 0)
+        return;
+    if (m_throttle)
+        m_throttle->release(this);
+    if (error() != NoError)
+        emit error(error());
+    finish();
+}
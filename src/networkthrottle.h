@@ -0,0 +1,139 @@
+/*
+  This file is part of the PhantomJS project from Ofi Labs.
+
+  Copyright (C) 2011 Ariya Hidayat <ariya.hidayat@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef NETWORKTHROTTLE_H
+#define NETWORKTHROTTLE_H
+
+#include <QHash>
+#include <QList>
+#include <QNetworkAccessManager>
+#include <QPointer>
+#include <QTime>
+#include <QTimer>
+
+#include "proxyreply.h"
+
+class NetworkAccessManager;
+class ThrottledReply;
+
+// Emulated network conditions. Rates are in bytes per second and 0 means
+// unlimited, as does a connection limit of 0.
+struct ThrottleProfile
+{
+    ThrottleProfile();
+
+    static bool parse(const QString &text, ThrottleProfile *profile);
+    bool isNull() const;
+
+    int latency;
+    int downloadRate;
+    int uploadRate;
+    int maxConnectionsPerHost;
+};
+
+// Decides when throttled replies may send their request and how many bytes
+// they may hand to the page. Requests wait for a free connection to their
+// host, then for the latency and the time the upload takes at the emulated
+// rate. The download rate is shared by all replies, like a single link.
+class NetworkThrottle: public QObject
+{
+    Q_OBJECT
+
+public:
+    NetworkThrottle(NetworkAccessManager *manager);
+
+    void setProfile(const ThrottleProfile &profile);
+    ThrottleProfile profile() const;
+
+    void enqueue(ThrottledReply *reply);
+    void send(ThrottledReply *reply);
+    void release(ThrottledReply *reply);
+    void wake();
+
+private slots:
+    void pump();
+
+private:
+    void connectReply(ThrottledReply *reply);
+
+    NetworkAccessManager *m_manager;
+    ThrottleProfile m_profile;
+    QHash<QString, int> m_connections;
+    QHash<QString, QList<ThrottledReply*> > m_waiting;
+    QList<ThrottledReply*> m_active;
+    QTimer m_pumpTimer;
+    QTime m_lastPump;
+    qint64 m_credit;
+};
+
+// The reply handed to the page. The real reply is only attached once the
+// throttle sends the request, and its data is passed on as the throttle
+// allows.
+class ThrottledReply: public ProxyReply
+{
+    Q_OBJECT
+
+public:
+    ThrottledReply(NetworkThrottle *throttle, QNetworkAccessManager::Operation op,
+                   const QNetworkRequest &request, QIODevice *outgoingData, QObject *parent = 0);
+    ~ThrottledReply();
+
+    void abort();
+    qint64 bytesAvailable() const;
+
+    QString hostKey() const;
+    QIODevice *outgoingData() const;
+    qint64 uploadSize() const;
+
+    qint64 pendingBytes() const;
+    void pass(qint64 maxSize);
+
+protected:
+    qint64 readData(char *data, qint64 maxSize);
+
+protected slots:
+    void forwardReadyRead();
+    void forwardDownloadProgress(qint64 received, qint64 total);
+    void forwardError(QNetworkReply::NetworkError code);
+    void forwardFinished();
+
+private slots:
+    void send();
+
+private:
+    void finishIfDone();
+
+    QPointer<NetworkThrottle> m_throttle;
+    QIODevice *m_outgoingData;
+    QByteArray m_buffer;
+    qint64 m_passed;
+    bool m_replyFinished;
+};
+
+#endif // NETWORKTHROTTLE_H
@@ -0,0 +1,161 @@
+/*
+  This file is part of the PhantomJS project from Ofi Labs.
+
+  Copyright (C) 2011 Ariya Hidayat <ariya.hidayat@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "outputstream.h"
+#include "jsonwriter.h"
+
+#include <QTextCodec>
+
+#include <iostream>
+#include <string.h>
+
+OutputStream::OutputStream(const QString &path, const QVariantMap &options, QObject *parent)
+    : QObject(parent)
+    , m_path(path)
+    , m_options(options)
+    , m_codec(0)
+    , m_used(0)
+{
+    if (options.contains("encoding")) {
+        const QString encoding = options.value("encoding").toString();
+        m_codec = QTextCodec::codecForName(encoding.toLatin1());
+        if (!m_codec)
+            std::cerr << "Unknown encoding '" << qPrintable(encoding) << "', using UTF-8" << std::endl;
+    }
+
+    int bufferSize = 64 * 1024;
+    if (options.contains("bufferSize"))
+        bufferSize = qMax(1, options.value("bufferSize").toInt());
+    m_buffer.resize(bufferSize);
+
+    // Our own buffer already batches the writes, so the file is unbuffered.
+    QIODevice::OpenMode mode = QIODevice::WriteOnly | QIODevice::Unbuffered;
+    bool opened;
+    if (path == "stdout" || path == "-") {
+        opened = m_file.open(1, mode);
+    } else if (path == "stderr") {
+        opened = m_file.open(2, mode);
+    } else if (path.startsWith("fd:")) {
+        bool ok = false;
+        int fd = path.mid(3).toInt(&ok);
+        opened = ok && m_file.open(fd, mode);
+    } else {
+        if (options.value("append").toBool())
+            mode |= QIODevice::Append;
+        else
+            mode |= QIODevice::Truncate;
+        m_file.setFileName(path);
+        opened = m_file.open(mode);
+    }
+
+    if (!opened)
+        std::cerr << "Unable to open output stream '" << qPrintable(path) << "'" << std::endl;
+}
+
+OutputStream::~OutputStream()
+{
+    close();
+}
+
+void OutputStream::setCodec(QTextCodec *codec)
+{
+    m_codec = codec;
+}
+
+QString OutputStream::path() const
+{
+    return m_path;
+}
+
+QVariantMap OutputStream::options() const
+{
+    return m_options;
+}
+
+bool OutputStream::isOpen() const
+{
+    return m_file.isOpen();
+}
+
+void OutputStream::writeRaw(const char *data, int size)
+{
+    if (!m_file.isOpen())
+        return;
+
+    if (m_used + size > m_buffer.size()) {
+        flush();
+        // Anything that would not fit into an empty buffer goes out directly.
+        if (size >= m_buffer.size()) {
+            m_file.write(data, size);
+            return;
+        }
+    }
+    memcpy(m_buffer.data() + m_used, data, size);
+    m_used += size;
+}
+
+void OutputStream::append(const QString &data)
+{
+    const QByteArray encoded = m_codec ? m_codec->fromUnicode(data) : data.toUtf8();
+    writeRaw(encoded.constData(), encoded.size());
+}
+
+void OutputStream::write(const QString &data)
+{
+    append(data);
+}
+
+void OutputStream::writeln(const QString &data)
+{
+    append(data);
+    writeRaw("\n", 1);
+}
+
+void OutputStream::writeJSON(const QVariant &value)
+{
+    QByteArray json;
+    appendJson(json, value);
+    json += '\n';
+    if (m_codec && m_codec->mibEnum() != 106) // 106 is UTF-8
+        json = m_codec->fromUnicode(QString::fromUtf8(json));
+    writeRaw(json.constData(), json.size());
+}
+
+void OutputStream::flush()
+{
+    if (m_used > 0 && m_file.isOpen())
+        m_file.write(m_buffer.constData(), m_used);
+    m_used = 0;
+}
+
+void OutputStream::close()
+{
+    flush();
+    m_file.close();
+}
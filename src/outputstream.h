@@ -0,0 +1,77 @@
+/*
+  This file is part of the PhantomJS project from Ofi Labs.
+
+  Copyright (C) 2011 Ariya Hidayat <ariya.hidayat@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef OUTPUTSTREAM_H
+#define OUTPUTSTREAM_H
+
+#include <QFile>
+#include <QObject>
+#include <QVariantMap>
+
+class QTextCodec;
+
+// A named output target handed to scripts by phantom.openStream(). Text is
+// encoded once into a large buffer that is written out only when it fills
+// up, on flush() or on close().
+class OutputStream: public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(QString path READ path)
+    Q_PROPERTY(bool isOpen READ isOpen)
+
+public:
+    OutputStream(const QString &path, const QVariantMap &options = QVariantMap(), QObject *parent = 0);
+    ~OutputStream();
+
+    void setCodec(QTextCodec *codec);
+    void writeRaw(const char *data, int size);
+
+    QString path() const;
+    QVariantMap options() const;
+    bool isOpen() const;
+
+public slots:
+    void write(const QString &data);
+    void writeln(const QString &data);
+    void writeJSON(const QVariant &value);
+    void flush();
+    void close();
+
+private:
+    void append(const QString &data);
+
+    QString m_path;
+    QVariantMap m_options;
+    QFile m_file;
+    QTextCodec *m_codec;
+    QByteArray m_buffer;
+    int m_used;
+};
+
+#endif // OUTPUTSTREAM_H
@@ -31,9 +31,21 @@
 #include <QtGui>
 #include <QtWebKit>
 #include <iostream>
+#include <stdio.h>
+#include <time.h>
 
 #include <gifwriter.h>
+#include "consolewriter.h"
+#include "cookiejar.h"
 #include "csconverter.h"
+#include "domfingerprint.h"
+#include "imagediff.h"
+#include "jsonwriter.h"
+#include "networkaccessmanager.h"
+#include "networkthrottle.h"
+#include "outputstream.h"
+#include "renderbufferpool.h"
+#include "rendercache.h"
 
 #if QT_VERSION < QT_VERSION_CHECK(4, 5, 0)
 #error Use Qt 4.5 or later version
@@ -58,6 +70,21 @@ void showUsage()
     file.close();
 }
 
+// Per-phase startup timings, printed to stderr with --startup-trace.
+static bool startupTraceEnabled = false;
+static QTime startupTimer;
+static int startupLastMark = 0;
+
+static void startupTrace(const char *phase)
+{
+    if (!startupTraceEnabled)
+        return;
+    const int now = startupTimer.elapsed();
+    std::cerr << "startup: " << phase << " " << (now - startupLastMark)
+              << " ms (" << now << " ms total)" << std::endl;
+    startupLastMark = now;
+}
+
 class WebPage: public QWebPage
 {
     Q_OBJECT
@@ -67,6 +94,9 @@ public:
 public slots:
     bool shouldInterruptJavaScript();
 
+private slots:
+    void scriptIdle();
+
 protected:
     void javaScriptAlert(QWebFrame *originatingFrame, const QString &msg);
     void javaScriptConsoleMessage(const QString &message, int lineNumber, const QString &sourceID);
@@ -74,7 +104,13 @@ protected:
     QString chooseFile(QWebFrame * parentFrame, const QString & suggestedFile);
 
 private:
+    ConsoleWriter *m_console;
     QString m_userAgent;
+    int m_scriptTimeout;
+    bool m_scriptRunning;
+    bool m_checkingInterrupt;
+    clock_t m_lastCheck;
+    double m_scriptTime;
     QMap<QString, QString> m_allowedFiles;
     QString m_nextFileTag;
     friend class Phantom;
@@ -82,6 +118,12 @@ private:
 
 WebPage::WebPage(QObject *parent)
     : QWebPage(parent)
+    , m_console(0)
+    , m_scriptTimeout(0)
+    , m_scriptRunning(false)
+    , m_checkingInterrupt(false)
+    , m_lastCheck(0)
+    , m_scriptTime(0)
 {
     m_userAgent = QWebPage::userAgentForUrl(QUrl());
 }
@@ -89,22 +131,56 @@ WebPage::WebPage(QObject *parent)
 void WebPage::javaScriptAlert(QWebFrame *originatingFrame, const QString &msg)
 {
     Q_UNUSED(originatingFrame);
-    std::cout << "JavaScript alert: " << qPrintable(msg) << std::endl;
+    m_console->write("alert", msg);
 }
 
 void WebPage::javaScriptConsoleMessage(const QString &message, int lineNumber, const QString &sourceID)
 {
-    if (!sourceID.isEmpty())
-        std::cout << qPrintable(sourceID) << ":" << lineNumber << " ";
-    std::cout << qPrintable(message) << std::endl;
+    m_console->write("console", message, sourceID, lineNumber);
 }
 
+// WebKit asks whether to interrupt a script after every ten seconds of CPU
+// time it spends without returning to the event loop.
+static const int ScriptCheckInterval = 10000;
+
 bool WebPage::shouldInterruptJavaScript()
 {
+    // The CPU time is summed up check by check in milliseconds. clock()
+    // wraps around after about 36 minutes with a 32-bit clock_t; a check
+    // across the wrap adds nothing.
+    const clock_t now = clock();
+    if (!m_scriptRunning) {
+        m_scriptRunning = true;
+        m_scriptTime = ScriptCheckInterval;
+    } else {
+        m_scriptTime += qMax((double(now) - double(m_lastCheck)) / CLOCKS_PER_SEC * 1000, 0.0);
+    }
+    m_lastCheck = now;
+
+    const qint64 elapsed = qint64(m_scriptTime);
+    if (m_scriptTimeout > 0 && elapsed >= m_scriptTimeout) {
+        m_scriptRunning = false;
+        m_console->write("interrupt", QString("%1 ran for %2 ms of CPU time")
+                         .arg(mainFrame()->url().toString()).arg(elapsed));
+        return true;
+    }
+
+    m_checkingInterrupt = true;
     QApplication::processEvents(QEventLoop::AllEvents, 42);
+    m_checkingInterrupt = false;
+
+    // Delivered by the next check while the same script keeps running, or by
+    // the event loop once it has finished.
+    QTimer::singleShot(0, this, SLOT(scriptIdle()));
     return false;
 }
 
+void WebPage::scriptIdle()
+{
+    if (!m_checkingInterrupt)
+        m_scriptRunning = false;
+}
+
 QString WebPage::userAgentForUrl(const QUrl &url) const
 {
     Q_UNUSED(url);
@@ -120,71 +196,35 @@ QString WebPage::chooseFile(QWebFrame *parentFrame, const QString &suggestedFile
     return QString();
 }
 
-class NetworkCookieJar: public QNetworkCookieJar
+// A private directory for --storage=memory, on tmpfs where available, so
+// that concurrent processes neither share nor lock each other's databases.
+static QString createEphemeralStorage()
 {
-public:
-    QVariantList cookies() const;
-    bool setCookies(const QVariantList& cookies);
-};
-
-QVariantList NetworkCookieJar::cookies() const
-{
-    QVariantList result;
-    foreach (const QNetworkCookie& cookie, QNetworkCookieJar::allCookies()) {
-        QVariantMap cookieEntry;
-        cookieEntry["domain"] = cookie.domain();
-        cookieEntry["name"] = QString(cookie.name());
-        cookieEntry["value"] = QString(cookie.value());
-        cookieEntry["path"] = cookie.path();
-
-        if (!cookie.isSessionCookie())
-            cookieEntry["expiration"] = cookie.expirationDate().toString("ddd, dd-MMM-yyyy hh:mm:ss 'GMT'");
-        if (cookie.isHttpOnly())
-            cookieEntry["httponly"] = true;
-        if (cookie.isSecure())
-            cookieEntry["secure"] = true;
-
-        result.append(cookieEntry);
+    QString base = QDir::tempPath();
+#ifdef Q_OS_LINUX
+    if (QFileInfo("/dev/shm").isWritable())
+        base = "/dev/shm";
+#endif
+    qsrand(QTime::currentTime().msec() ^ QCoreApplication::applicationPid());
+    QDir dir(base);
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        const QString name = QString("phantomjs-storage-%1-%2").arg(QCoreApplication::applicationPid()).arg(qrand());
+        if (dir.mkdir(name))
+            return dir.absoluteFilePath(name);
     }
-
-    return result;
+    return QString();
 }
 
-bool NetworkCookieJar::setCookies(const QVariantList& cookies)
+static void removeDirectory(const QString &path)
 {
-    QList<QNetworkCookie> newCookies;
-    foreach (const QVariant& listItem, cookies) {
-        if (!listItem.canConvert(QVariant::Map)) return false;
-        QVariantMap cookieEntry(listItem.toMap());
-
-        QNetworkCookie cookie;
-
-        if (!cookieEntry.contains("domain")) return false;
-        cookie.setDomain(cookieEntry.value("domain").toString());
-
-        if(!cookieEntry.contains("name")) return false;
-        cookie.setName(cookieEntry.value("name").toByteArray());
-
-        if(!cookieEntry.contains("value")) return false;
-        cookie.setValue(cookieEntry.value("value").toByteArray());
-
-        if (!cookieEntry.contains("path")) return false;
-        cookie.setPath(cookieEntry.value("path").toString());
-
-        if (cookieEntry.contains("expiration"))
-            cookie.setExpirationDate(QDateTime::fromString(cookieEntry.value("expiration").toString(), "ddd, dd-MMM-yyyy hh:mm:ss 'GMT'"));
-
-        if (cookieEntry.contains("httponly"))
-            cookie.setHttpOnly(cookieEntry.value("httponly").toBool());
-
-        if (cookieEntry.contains("secure"))
-            cookie.setSecure(cookieEntry.value("secure").toBool());
-
-        newCookies.append(cookie);
+    QDir dir(path);
+    foreach (const QFileInfo &entry, dir.entryInfoList(QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot)) {
+        if (entry.isDir() && !entry.isSymLink())
+            removeDirectory(entry.absoluteFilePath());
+        else
+            QFile::remove(entry.absoluteFilePath());
     }
-
-    QNetworkCookieJar::setAllCookies(newCookies);
-    return true;
+    dir.rmdir(path);
 }
 
 class Phantom: public QObject
@@ -194,6 +234,10 @@ class Phantom: public QObject
     Q_PROPERTY(QString content READ content WRITE setContent)
     Q_PROPERTY(QString loadStatus READ loadStatus)
     Q_PROPERTY(int loadTime READ loadTime)
+    Q_PROPERTY(QStringList timedOutResources READ timedOutResources)
+    Q_PROPERTY(QVariantMap dnsStats READ dnsStats)
+    Q_PROPERTY(QVariantMap renderBufferStats READ renderBufferStats)
+    Q_PROPERTY(bool renderCacheHit READ renderCacheHit)
     Q_PROPERTY(QString state READ state WRITE setState)
     Q_PROPERTY(QString userAgent READ userAgent WRITE setUserAgent)
     Q_PROPERTY(QVariantMap version READ version)
@@ -201,9 +245,12 @@ class Phantom: public QObject
     Q_PROPERTY(QVariantMap paperSize READ paperSize WRITE setPaperSize)
     Q_PROPERTY(QVariantMap clipRect READ clipRect WRITE setClipRect)
     Q_PROPERTY(QVariantList cookies READ cookies WRITE setCookies)
+    Q_PROPERTY(QVariant gifPalette READ gifPalette WRITE setGifPalette)
+    Q_PROPERTY(int scriptTimeout READ scriptTimeout WRITE setScriptTimeout)
 
 public:
     Phantom(QObject *parent = 0);
+    ~Phantom();
 
     QStringList args() const;
 
@@ -217,6 +264,13 @@ public:
 
     int loadTime() const;
 
+    QStringList timedOutResources() const;
+
+    QVariantMap dnsStats() const;
+    QVariantMap renderBufferStats() const;
+
+    bool renderCacheHit() const;
+
     void setState(const QString &value);
     QString state() const;
 
@@ -237,57 +291,124 @@ public:
     QVariantList cookies() const;
     bool setCookies(const QVariantList &cookies);
 
+    void setGifPalette(const QVariant &palette);
+    QVariant gifPalette() const;
+
+    void setScriptTimeout(int ms);
+    int scriptTimeout() const;
+
 public slots:
     void exit(int code = 0);
-    void open(const QString &address);
+    void open(const QString &address, const QVariantMap &options = QVariantMap());
     void setFormInputFile(QWebElement el, const QString &fileTag);
     bool render(const QString &fileName);
+    QVariant compareRender(const QString &baselinePath, const QVariantMap &options = QVariantMap());
     void sleep(int ms);
     void setOutputPath(const QString &path);
     void write(const QString &output);
     void writeln(const QString &output);
+    QObject *openStream(const QString &path, const QVariantMap &options = QVariantMap());
+    QVariant extract(const QString &selector, const QVariantMap &options = QVariantMap());
+    QString fingerprint(const QVariantMap &options = QVariantMap());
+    bool saveContent(const QString &fileName, const QVariantMap &options = QVariantMap());
+    bool addCookie(const QVariantMap &cookie);
+    bool deleteCookie(const QString &name, const QString &domain, const QString &path = "/");
+    QVariantList cookiesForUrl(const QString &url) const;
+    bool saveSession(const QString &fileName);
 
 private slots:
     void inject();
+    void watchFrame(QWebFrame *frame);
+    void restoreStorage();
     void finish(bool);
     void loadStart();
+    void loadTimedOut();
+    void resourceTimedOut(const QUrl &url);
+    void redirected(const QUrl &url, const QUrl &target);
+    void documentReceived(const QUrl &url, const QByteArray &etag, const QByteArray &lastModified);
     bool renderPdf(const QString &fileName);
 
 private:
+    QImage renderImage(QImage::Format format);
+    void learnGifPalette(const QImage &frame);
+    bool isDocumentUrl(const QUrl &url) const;
+    QByteArray renderOptions(const QString &format) const;
+    QByteArray renderValidator() const;
+    void setUpStorage();
+    bool loadSession(const QString &fileName, bool storageEnabled);
+    void collectStorage(QWebFrame *frame, QMap<QString, QVariantMap> *storage);
+
     QString m_scriptFile;
     QStringList m_args;
     QString m_proxyHost;
     int m_proxyPort;
+    QString m_cookiesFile;
+    bool m_compileCache;
+    QString m_compileCachePath;
+    QString m_sessionFile;
+    QString m_recordFile;
+    QString m_replayFile;
+    ThrottleProfile m_throttle;
+    QMap<QString, QVariantMap> m_pendingStorage;
     QString m_loadStatus;
     QTime m_loadTimer;
     int m_loadTime;
+    QTimer m_loadTimeout;
+    bool m_timedOut;
+    QUrl m_documentUrl;
+    QStringList m_timedOutResources;
+    QHash<QString, QByteArray> m_documentValidators;
+    RenderCache m_renderCache;
+    RenderBufferPool m_renderBuffers;
+    bool m_renderCacheHit;
+    ConsoleWriter m_console;
+    NetworkAccessManager m_networkAccessManager;
     WebPage m_page;
     NetworkCookieJar m_cookieJar;
     int m_returnValue;
     QString m_script;
     QString m_state;
-    CSConverter *m_converter;
+    QString m_storageMode;
+    QString m_storageLocation;
+    bool m_storageReady;
+    bool m_loadingInitialDocument;
+    QString m_ephemeralStorage;
     QVariantMap m_paperSize; // For PDF output via render()
     QRect m_clipRect;
-    QFile *m_outputFile;
+    QVariant m_gifPaletteSetting;
+    GifPalette m_gifPalette;
+    int m_gifSharedFrames;
+    int m_gifSampledFrames;
+    QVector<QRgb> m_gifSamples;
+    OutputStream *m_output;
+    QMap<QString, OutputStream*> m_streams;
 
 };
 
 Phantom::Phantom(QObject *parent)
     : QObject(parent)
     , m_proxyPort(1080)
+    , m_compileCache(true)
+    , m_timedOut(false)
+    , m_renderCacheHit(false)
     , m_returnValue(0)
-    , m_converter(0)
-    , m_outputFile(NULL)
+    , m_storageMode("disk")
+    , m_storageReady(false)
+    , m_loadingInitialDocument(false)
+    , m_gifSharedFrames(0)
+    , m_gifSampledFrames(0)
+    , m_output(0)
 {
+    startupTrace("page");
+
+    m_page.m_console = &m_console;
+
     QPalette palette = m_page.palette();
     palette.setBrush(QPalette::Base, Qt::transparent);
     m_page.setPalette(palette);
 
     bool autoLoadImages = true;
     bool pluginsEnabled = false;
-    QString storageLocation = QDesktopServices::storageLocation(QDesktopServices::DataLocation);
-
 
     // second argument: script name
     QStringList args = QApplication::arguments();
@@ -308,9 +429,37 @@ Phantom::Phantom(QObject *parent)
             continue;
         }
         if (arg == "--storage-path" && argIterator.hasNext()) {
-          storageLocation = argIterator.next();
+          m_storageLocation = argIterator.next();
           continue;
         }
+        if (arg == "--storage=memory" || arg == "--storage=disk" || arg == "--storage=off") {
+            m_storageMode = arg.mid(10);
+            continue;
+        }
+        if (arg.startsWith("--cookies-file=")) {
+            m_cookiesFile = arg.mid(15).trimmed();
+            continue;
+        }
+        if (arg.startsWith("--load-session=")) {
+            m_sessionFile = arg.mid(15).trimmed();
+            continue;
+        }
+        if (arg == "--compile-cache=yes") {
+            m_compileCache = true;
+            continue;
+        }
+        if (arg == "--compile-cache=no") {
+            m_compileCache = false;
+            continue;
+        }
+        if (arg == "--compile-cache-path" && argIterator.hasNext()) {
+            m_compileCachePath = argIterator.next();
+            continue;
+        }
+        if (arg == "--startup-trace") {
+            // Already picked up by main(), before the application started.
+            continue;
+        }
         if (arg == "--load-images=yes") {
             autoLoadImages = true;
             continue;
@@ -327,6 +476,68 @@ Phantom::Phantom(QObject *parent)
             pluginsEnabled = false;
             continue;
         }
+        if (arg == "--console-format=text") {
+            m_console.setFormat(ConsoleWriter::PlainText);
+            continue;
+        }
+        if (arg == "--console-format=json") {
+            m_console.setFormat(ConsoleWriter::JsonLines);
+            continue;
+        }
+        if (arg.startsWith("--console-flush-interval=")) {
+            m_console.setFlushInterval(arg.mid(25).toInt());
+            continue;
+        }
+        if (arg.startsWith("--console-queue-size=")) {
+            m_console.setMaxQueueSize(arg.mid(21).toInt());
+            continue;
+        }
+        if (arg.startsWith("--record=")) {
+            m_recordFile = arg.mid(9).trimmed();
+            continue;
+        }
+        if (arg.startsWith("--render-cache=")) {
+            m_renderCache.setDirectory(arg.mid(15).trimmed());
+            continue;
+        }
+        if (arg.startsWith("--replay=")) {
+            m_replayFile = arg.mid(9).trimmed();
+            continue;
+        }
+        if (arg.startsWith("--host-map=")) {
+#if QT_VERSION < QT_VERSION_CHECK(4, 7, 0)
+            std::cerr << "--host-map needs Qt 4.7 or later" << std::endl;
+            exit(-1);
+            return;
+#endif
+            if (!m_networkAccessManager.resolver()->setHostMap(arg.mid(11))) {
+                std::cerr << "Invalid host map '" << qPrintable(arg.mid(11)) << "'" << std::endl;
+                exit(-1);
+                return;
+            }
+            continue;
+        }
+        if (arg.startsWith("--dns-cache-ttl=")) {
+#if QT_VERSION < QT_VERSION_CHECK(4, 7, 0)
+            std::cerr << "--dns-cache-ttl needs Qt 4.7 or later" << std::endl;
+            exit(-1);
+            return;
+#endif
+            m_networkAccessManager.resolver()->setCacheTtl(arg.mid(16).toInt());
+            continue;
+        }
+        if (arg.startsWith("--throttle=")) {
+            if (!ThrottleProfile::parse(arg.mid(11), &m_throttle)) {
+                std::cerr << "Invalid throttle profile '" << qPrintable(arg.mid(11)) << "'" << std::endl;
+                exit(-1);
+                return;
+            }
+            continue;
+        }
+        if (arg.startsWith("--script-timeout=")) {
+            m_page.m_scriptTimeout = arg.mid(17).toInt();
+            continue;
+        }
         if (arg.startsWith("--proxy=")) {
             m_proxyHost = arg.mid(8).trimmed();
             if (m_proxyHost.lastIndexOf(':') > 0) {
@@ -339,6 +550,12 @@ Phantom::Phantom(QObject *parent)
             }
             continue;
         }
+        // Handled in main(), which only takes it as the first argument.
+        if (arg == "--compile") {
+            std::cerr << "--compile must come first: phantomjs --compile script.coffee script.js" << std::endl;
+            exit(-1);
+            return;
+        }
         if (arg.startsWith("--")) {
             std::cerr << "Unknown option '" << qPrintable(arg) << "'" << std::endl;
             exit(-1);
@@ -354,6 +571,9 @@ Phantom::Phantom(QObject *parent)
         return;
     }
 
+    startupTrace("options");
+
+    // Only a flag: the system configuration is queried on the first request.
     if (m_proxyHost.isEmpty()) {
         QNetworkProxyFactory::setUseSystemConfiguration(true);
     } else {
@@ -371,32 +591,69 @@ Phantom::Phantom(QObject *parent)
     connect(&m_page, SIGNAL(loadFinished(bool)), this, SLOT(finish(bool)));
     connect(&m_page, SIGNAL(loadStarted()), this, SLOT(loadStart()));
 
-    m_page.networkAccessManager()->setCookieJar(&m_cookieJar);
+    m_page.setNetworkAccessManager(&m_networkAccessManager);
+    m_networkAccessManager.setCookieJar(&m_cookieJar);
+    connect(&m_networkAccessManager, SIGNAL(resourceTimedOut(QUrl)), SLOT(resourceTimedOut(QUrl)));
+    connect(&m_networkAccessManager, SIGNAL(redirected(QUrl, QUrl)), SLOT(redirected(QUrl, QUrl)));
+    if (m_renderCache.isEnabled()) {
+        connect(&m_networkAccessManager, SIGNAL(documentReceived(QUrl, QByteArray, QByteArray)),
+                SLOT(documentReceived(QUrl, QByteArray, QByteArray)));
+    }
+    if (!m_recordFile.isEmpty() && !m_networkAccessManager.setRecordFile(m_recordFile))
+        std::cerr << "Unable to create the archive " << qPrintable(m_recordFile) << std::endl;
+    if (!m_replayFile.isEmpty() && !m_networkAccessManager.setReplayFile(m_replayFile))
+        std::cerr << "Unable to open the archive " << qPrintable(m_replayFile) << std::endl;
+    m_networkAccessManager.setThrottle(m_throttle);
+
+    m_loadTimeout.setSingleShot(true);
+    connect(&m_loadTimeout, SIGNAL(timeout()), SLOT(loadTimedOut()));
+    if (!m_cookiesFile.isEmpty() && !m_cookieJar.setCookiesFile(m_cookiesFile))
+        std::cerr << "Unable to open the cookies file " << qPrintable(m_cookiesFile) << std::endl;
+
+    startupTrace("network");
+
+    // Where the databases go is only worked out by setUpStorage(), once the
+    // first page loads.
+    const bool storageEnabled = m_storageMode != "off";
 
     m_page.settings()->setAttribute(QWebSettings::AutoLoadImages, autoLoadImages);
     m_page.settings()->setAttribute(QWebSettings::PluginsEnabled, pluginsEnabled);
 
-    m_page.settings()->setAttribute(QWebSettings::OfflineStorageDatabaseEnabled, true);
-    m_page.settings()->setOfflineStoragePath(storageLocation);
-
-    m_page.settings()->setAttribute(QWebSettings::LocalStorageDatabaseEnabled, true);
+    m_page.settings()->setAttribute(QWebSettings::OfflineStorageDatabaseEnabled, storageEnabled);
+    m_page.settings()->setAttribute(QWebSettings::LocalStorageDatabaseEnabled, storageEnabled);
 
 #if QT_VERSION >= QT_VERSION_CHECK(4, 7, 0)
     m_page.settings()->setAttribute(QWebSettings::FrameFlatteningEnabled, true);
 #endif
 
 #if QT_VERSION >= QT_VERSION_CHECK(4, 6, 0)
-    m_page.settings()->setAttribute(QWebSettings::LocalStorageEnabled, true);
-    m_page.settings()->setLocalStoragePath(storageLocation);
+    m_page.settings()->setAttribute(QWebSettings::LocalStorageEnabled, storageEnabled);
 #endif
 
-    // Ensure we have document.body.
-    m_page.mainFrame()->setHtml("<html><body></body></html>");
+    startupTrace("settings");
+
+    if (!m_sessionFile.isEmpty()) {
+        if (loadSession(m_sessionFile, storageEnabled)) {
+            if (!m_pendingStorage.isEmpty()) {
+                connect(m_page.mainFrame(), SIGNAL(javaScriptWindowObjectCleared()), SLOT(restoreStorage()));
+                connect(&m_page, SIGNAL(frameCreated(QWebFrame*)), SLOT(watchFrame(QWebFrame*)));
+            }
+        } else {
+            std::cerr << "Unable to load the session " << qPrintable(m_sessionFile) << std::endl;
+        }
+        startupTrace("session");
+    }
 
     m_page.mainFrame()->setScrollBarPolicy(Qt::Horizontal, Qt::ScrollBarAlwaysOff);
     m_page.mainFrame()->setScrollBarPolicy(Qt::Vertical, Qt::ScrollBarAlwaysOff);
 }
 
+Phantom::~Phantom()
+{
+    if (!m_ephemeralStorage.isEmpty())
+        removeDirectory(m_ephemeralStorage);
+}
+
 QStringList Phantom::args() const
 {
     return m_args;
@@ -424,6 +681,15 @@ bool Phantom::execute()
         exit(1);
         return false;
     }
+
+    // Ensure we have document.body. The document is only made for a script
+    // that is about to run, and before m_script is set, since its load
+    // finishes right away and runs whatever m_script holds.
+    m_loadingInitialDocument = true;
+    m_page.mainFrame()->setHtml("<html><body></body></html>");
+    m_loadingInitialDocument = false;
+    startupTrace("initial document");
+
     m_script = QString::fromUtf8(file.readAll());
     file.close();
 
@@ -431,13 +697,26 @@ bool Phantom::execute()
         m_script.prepend("//");
     }
 
+    startupTrace("script load");
+
     if (m_scriptFile.endsWith(".coffee")) {
-        if (!m_converter)
-            m_converter = new CSConverter(this);
-        m_script = m_converter->convert(m_script);
+        QString cachePath;
+        if (m_compileCache) {
+            cachePath = m_compileCachePath;
+            if (cachePath.isEmpty())
+                cachePath = QDesktopServices::storageLocation(QDesktopServices::CacheLocation) + "/coffee-script";
+        }
+        CSConverter *converter = CSConverter::instance();
+        converter->setCacheDirectory(cachePath);
+        m_script = converter->convert(m_script);
+        startupTrace("coffeescript");
     }
 
+    // The script may already use storage in the initial document.
+    if (!m_storageReady)
+        setUpStorage();
     m_page.mainFrame()->evaluateJavaScript(m_script);
+    startupTrace("script run");
     return true;
 }
 
@@ -445,7 +724,10 @@ void Phantom::exit(int code)
 {
     m_returnValue = code;
     disconnect(&m_page, SIGNAL(loadFinished(bool)), this, SLOT(finish(bool)));
-    delete m_outputFile;
+    if (m_output)
+        m_output->flush();
+    foreach (OutputStream *stream, m_streams)
+        stream->flush();
     QTimer::singleShot(0, qApp, SLOT(quit()));
 }
 
@@ -453,11 +735,91 @@ void Phantom::loadStart()
 {
     // Save the current time
     m_loadTimer.start();
+
+    if (!m_storageReady && !m_loadingInitialDocument)
+        setUpStorage();
+}
+
+// The databases are opened by WebKit only when a page uses them, but their
+// location has to be set before that. It is looked up, or created for
+// --storage=memory, when the first page starts loading or the script first
+// runs, whichever comes first.
+void Phantom::setUpStorage()
+{
+    m_storageReady = true;
+    if (m_storageMode == "off")
+        return;
+
+    if (m_storageMode == "memory") {
+        m_ephemeralStorage = createEphemeralStorage();
+        if (m_ephemeralStorage.isEmpty()) {
+            std::cerr << "Unable to create the in-memory storage, Local Storage and Web SQL are disabled" << std::endl;
+            m_storageMode = "off";
+            m_pendingStorage.clear();
+            m_page.settings()->setAttribute(QWebSettings::OfflineStorageDatabaseEnabled, false);
+            m_page.settings()->setAttribute(QWebSettings::LocalStorageDatabaseEnabled, false);
+#if QT_VERSION >= QT_VERSION_CHECK(4, 6, 0)
+            m_page.settings()->setAttribute(QWebSettings::LocalStorageEnabled, false);
+#endif
+            return;
+        }
+        m_storageLocation = m_ephemeralStorage;
+    } else if (m_storageLocation.isEmpty()) {
+        m_storageLocation = QDesktopServices::storageLocation(QDesktopServices::DataLocation);
+    }
+
+    m_page.settings()->setOfflineStoragePath(m_storageLocation);
+#if QT_VERSION >= QT_VERSION_CHECK(4, 6, 0)
+    m_page.settings()->setLocalStoragePath(m_storageLocation);
+#endif
+}
+
+void Phantom::loadTimedOut()
+{
+    m_timedOut = true;
+    m_networkAccessManager.abortAll();
+    m_page.triggerAction(QWebPage::Stop);
+}
+
+// A stalled subresource is only recorded, since the page can finish without
+// it. The load as a whole only timed out if the stalled one was the page.
+void Phantom::resourceTimedOut(const QUrl &url)
+{
+    m_timedOutResources += url.toString();
+    if (isDocumentUrl(url))
+        m_timedOut = true;
+}
+
+// The page's document moves along with each redirect it gets.
+void Phantom::redirected(const QUrl &url, const QUrl &target)
+{
+    if (isDocumentUrl(url))
+        m_documentUrl = target;
+}
+
+// The document opened last, after the redirects so far. Since Qt 4.6 the
+// frame also knows the URL of a load started by the page itself.
+bool Phantom::isDocumentUrl(const QUrl &url) const
+{
+#if QT_VERSION >= QT_VERSION_CHECK(4, 6, 0)
+    if (url == m_page.mainFrame()->requestedUrl())
+        return true;
+#endif
+    return url == m_documentUrl;
+}
+
+void Phantom::documentReceived(const QUrl &url, const QByteArray &etag, const QByteArray &lastModified)
+{
+    m_documentValidators.insert(url.toString(), etag + '\n' + lastModified);
 }
 
 void Phantom::finish(bool success)
 {
-    m_loadStatus = success ? "success" : "fail";
+    m_loadTimeout.stop();
+    if (success)
+        m_loadStatus = "success";
+    else
+        m_loadStatus = m_timedOut ? "timeout" : "fail";
     m_loadTime = m_loadTimer.elapsed();
     m_page.mainFrame()->evaluateJavaScript(m_script);
 }
@@ -477,61 +839,237 @@ int Phantom::loadTime() const
     return m_loadTime;
 }
 
-void Phantom::open(const QString &address)
+void Phantom::open(const QString &address, const QVariantMap &options)
 {
+    m_loadTimeout.stop();
     m_page.triggerAction(QWebPage::Stop);
     m_loadStatus = "loading";
-    m_page.mainFrame()->setUrl(address);
+
+    // Both limits are set per call. A stalled resource is aborted and the
+    // page finishes without it, unless it was the page itself.
+    m_timedOut = false;
+    m_timedOutResources.clear();
+    m_documentValidators.clear();
+    m_networkAccessManager.resolver()->resetStats();
+    m_networkAccessManager.setResourceTimeout(options.value("resourceTimeout").toInt());
+    const int timeout = options.value("timeout").toInt();
+    if (timeout > 0)
+        m_loadTimeout.start(timeout);
+
+    m_documentUrl = QUrl(address);
+    m_page.mainFrame()->setUrl(m_documentUrl);
 }
 
-bool Phantom::render(const QString &fileName)
+QStringList Phantom::timedOutResources() const
 {
-    QFileInfo fileInfo(fileName);
-    QDir dir;
-    dir.mkpath(fileInfo.absolutePath());
+    return m_timedOutResources;
+}
 
-    if (fileName.endsWith(".pdf", Qt::CaseInsensitive))
-        return renderPdf(fileName);
+QVariantMap Phantom::dnsStats() const
+{
+    return m_networkAccessManager.resolver()->stats();
+}
+
+QVariantMap Phantom::renderBufferStats() const
+{
+    return m_renderBuffers.stats();
+}
 
+bool Phantom::renderCacheHit() const
+{
+    return m_renderCacheHit;
+}
+
+// The settings besides the request that change the encoded output. For a
+// GIF that is the palette, as set or as learned by a 'shared' one.
+QByteArray Phantom::renderOptions(const QString &format) const
+{
+    if (format.toLower() != "gif")
+        return QByteArray();
+    if (m_gifPalette.isNull())
+        return m_gifPaletteSetting.toString().toUtf8();
+
+    QByteArray result("palette:");
+    foreach (QRgb color, m_gifPalette.colors())
+        result += QByteArray::number(color, 16) + ',';
+    return result;
+}
+
+// What a cached render depends on besides the request: the validators of
+// the main document and the DOM the page ended up with. The DOM is hashed
+// even when validators came, since script can change it after the load.
+QByteArray Phantom::renderValidator() const
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(m_documentValidators.value(m_page.mainFrame()->url().toString()));
+    hash.addData(m_page.mainFrame()->toHtml().toUtf8());
+    return hash.result().toHex();
+}
+
+// The raster engine only blends fast into premultiplied or opaque buffers.
+// Formats that drop the alpha channel anyway get an opaque one.
+static QImage::Format renderFormat(const QString &suffix)
+{
+    const QString format = suffix.toLower();
+    if (format == "jpg" || format == "jpeg" || format == "bmp" || format == "ppm")
+        return QImage::Format_RGB32;
+    // The GIF palette works on straight alpha.
+    if (format == "gif")
+        return QImage::Format_ARGB32;
+    return QImage::Format_ARGB32_Premultiplied;
+}
+
+// Saves a premultiplied buffer. Instead of letting the writer convert into
+// a second full-size image, the buffer is unpremultiplied in place and
+// handed over as ARGB32 sharing the same pixels.
+static bool saveUnpremultiplied(QImage &buffer, const QString &fileName)
+{
+    const int width = buffer.width();
+    for (int y = 0; y < buffer.height(); ++y) {
+        QRgb *line = reinterpret_cast<QRgb*>(buffer.scanLine(y));
+        for (int x = 0; x < width; ++x) {
+            const int alpha = qAlpha(line[x]);
+            if (alpha == 255)
+                continue;
+            if (alpha == 0) {
+                line[x] = 0;
+                continue;
+            }
+            line[x] = qRgba(qRed(line[x]) * 255 / alpha, qGreen(line[x]) * 255 / alpha,
+                            qBlue(line[x]) * 255 / alpha, alpha);
+        }
+    }
+    const QImage image(buffer.bits(), width, buffer.height(), buffer.bytesPerLine(), QImage::Format_ARGB32);
+    return image.save(fileName);
+}
+
+// Paints the page, or the clip rectangle of it, at its full contents size.
+// The image comes from the buffer pool and has to be released there.
+QImage Phantom::renderImage(QImage::Format format)
+{
     QSize viewportSize = m_page.viewportSize();
-    
-    QSize pageSize = m_page.mainFrame()->contentsSize(); 
-    
+    QSize pageSize = m_page.mainFrame()->contentsSize();
+
     QSize bufferSize;
     if (!m_clipRect.isEmpty()) {
         bufferSize = m_clipRect.size();
     } else {
         bufferSize = m_page.mainFrame()->contentsSize();
     }
-    
-    if (pageSize.isEmpty())
-        return false;
 
-    QImage buffer(bufferSize, QImage::Format_ARGB32);
-    buffer.fill(qRgba(255, 255, 255, 0));
+    if (pageSize.isEmpty())
+        return QImage();
+
+    uint fill = 0;
+    if (format == QImage::Format_RGB32)
+        fill = qRgb(255, 255, 255);
+    else if (format == QImage::Format_ARGB32)
+        fill = qRgba(255, 255, 255, 0);
+    QImage buffer = m_renderBuffers.acquire(bufferSize, format, fill);
     QPainter p(&buffer);
-    
+
     p.setRenderHint(QPainter::Antialiasing, true);
     p.setRenderHint(QPainter::TextAntialiasing, true);
     p.setRenderHint(QPainter::SmoothPixmapTransform, true);
 
     m_page.setViewportSize(pageSize);
-        
+
     if (!m_clipRect.isEmpty()) {
         p.translate(-m_clipRect.left(), -m_clipRect.top());
         m_page.mainFrame()->render(&p, QRegion(m_clipRect));
     } else {
         m_page.mainFrame()->render(&p);
     }
-    
+
     p.end();
     m_page.setViewportSize(viewportSize);
+    return buffer;
+}
+
+bool Phantom::render(const QString &fileName)
+{
+    QFileInfo fileInfo(fileName);
+    QDir dir;
+    dir.mkpath(fileInfo.absolutePath());
+
+    m_renderCacheHit = false;
+    if (fileName.endsWith(".pdf", Qt::CaseInsensitive))
+        return renderPdf(fileName);
+
+    QByteArray cacheKey;
+    QByteArray validator;
+    if (m_renderCache.isEnabled()) {
+        cacheKey = RenderCache::key(m_page.mainFrame()->url(), m_page.viewportSize(), m_clipRect,
+                                    fileInfo.suffix(), renderOptions(fileInfo.suffix()));
+        validator = renderValidator();
+        if (m_renderCache.fetch(cacheKey, validator, fileName)) {
+            m_renderCacheHit = true;
+            return true;
+        }
+    }
 
+    QImage buffer = renderImage(renderFormat(fileInfo.suffix()));
+    if (buffer.isNull())
+        return false;
+
+    bool saved;
     if (fileName.toLower().endsWith(".gif")) {
-        return exportGif(buffer, fileName);
+        if (m_gifPalette.isNull() && m_gifSharedFrames > 0)
+            learnGifPalette(buffer);
+        saved = exportGif(buffer, fileName, m_gifPalette);
+    } else if (buffer.format() == QImage::Format_ARGB32_Premultiplied) {
+        saved = saveUnpremultiplied(buffer, fileName);
+    } else {
+        saved = buffer.save(fileName);
+    }
+    m_renderBuffers.release(buffer);
+
+    if (saved && !cacheKey.isEmpty())
+        m_renderCache.store(cacheKey, validator, fileName);
+    return saved;
+}
+
+// The fresh render is compared as it was painted, without encoding it,
+// so only the baseline has to be decoded.
+QVariant Phantom::compareRender(const QString &baselinePath, const QVariantMap &options)
+{
+    const QImage baseline(baselinePath);
+    if (baseline.isNull()) {
+        std::cerr << "Unable to read the baseline " << qPrintable(baselinePath) << std::endl;
+        return QVariant();
+    }
+
+    const QImage buffer = renderImage(QImage::Format_ARGB32_Premultiplied);
+    if (buffer.isNull())
+        return QVariant();
+
+    const int threshold = qBound(0, options.value("threshold", 0).toInt(), 255);
+    const QString diffOutput = options.value("diffOutput").toString();
+
+    QImage mask;
+    const ImageDiff diff = compareImages(buffer, baseline, threshold, diffOutput.isEmpty() ? 0 : &mask);
+    m_renderBuffers.release(buffer);
+
+    if (!diffOutput.isEmpty()) {
+        QDir().mkpath(QFileInfo(diffOutput).absolutePath());
+        if (!mask.save(diffOutput))
+            std::cerr << "Unable to write the difference to " << qPrintable(diffOutput) << std::endl;
+    }
+
+    QVariantList boxes;
+    foreach (const QRect &rect, diff.boxes) {
+        QVariantMap box;
+        box["x"] = rect.x();
+        box["y"] = rect.y();
+        box["width"] = rect.width();
+        box["height"] = rect.height();
+        boxes += box;
     }
 
-    return buffer.save(fileName);
+    QVariantMap result;
+    result["count"] = diff.count;
+    result["boxes"] = boxes;
+    return result;
 }
 
 int Phantom::returnValue() const
@@ -551,24 +1089,179 @@ void Phantom::sleep(int ms)
 
 void Phantom::setOutputPath(const QString& path)
 {
-    if (m_outputFile) delete m_outputFile;
+    delete m_output;
 
-    m_outputFile = new QFile(path);
-    m_outputFile->open(QIODevice::WriteOnly);
+    m_output = new OutputStream(path, QVariantMap(), this);
+    m_output->setCodec(QTextCodec::codecForLocale());
 }
 
 void Phantom::write(const QString& output)
 {
-    if (m_outputFile)
-        m_outputFile->write(qPrintable(output));
+    if (m_output)
+        m_output->write(output);
 }
 
 void Phantom::writeln(const QString& output)
 {
-    if (m_outputFile) {
-        m_outputFile->write(qPrintable(output));
-        m_outputFile->write("\n");
+    if (m_output)
+        m_output->writeln(output);
+}
+
+QObject *Phantom::openStream(const QString &path, const QVariantMap &options)
+{
+    // Another call for an open stream gets the same one, as long as it
+    // does not ask for different options.
+    OutputStream *stream = m_streams.value(path);
+    if (stream && stream->isOpen()) {
+        if (!options.isEmpty() && options != stream->options()) {
+            std::cerr << "Output stream '" << qPrintable(path) << "' is already open with other options" << std::endl;
+            return 0;
+        }
+        return stream;
+    }
+
+    delete stream;
+    stream = new OutputStream(path, options, this);
+    m_streams[path] = stream;
+    return stream;
+}
+
+// A hex string, since the 64-bit hash does not fit in a JavaScript number.
+QString Phantom::fingerprint(const QVariantMap &options)
+{
+    DomFingerprint fingerprint(m_page.mainFrame()->documentElement(), options.value("attrs").toStringList());
+    fingerprint.ignore(options.value("ignore").toStringList());
+
+    const QString selector = options.value("selector").toString();
+    if (selector.isEmpty())
+        fingerprint.add();
+    else
+        fingerprint.add(selector);
+    return fingerprint.result();
+}
+
+QVariant Phantom::extract(const QString &selector, const QVariantMap &options)
+{
+    const QStringList attrs = options.value("attrs").toStringList();
+    const bool text = options.value("text", true).toBool();
+
+    OutputStream *stream = 0;
+    if (options.contains("output")) {
+        stream = m_streams.value(options.value("output").toString());
+        if (!stream || !stream->isOpen())
+            return QVariant();
+    }
+
+    // Every matching element becomes one row: its text (unless disabled)
+    // followed by the requested attributes in order.
+    QVariantList rows;
+    int count = 0;
+    const QWebElementCollection elements = m_page.mainFrame()->findAllElements(selector);
+    for (int i = 0; i < elements.count(); ++i) {
+        const QWebElement element = elements.at(i);
+        QVariantList row;
+        if (text)
+            row += element.toPlainText();
+        foreach (const QString &attr, attrs)
+            row += element.attribute(attr);
+
+        if (stream)
+            stream->writeJSON(row);
+        else
+            rows += QVariant(row);
+        ++count;
     }
+
+    if (stream)
+        return count;
+    return rows;
+}
+
+static quint32 crc32(const QByteArray &data, quint32 crc = 0)
+{
+    static quint32 table[256];
+    static bool tableReady = false;
+    if (!tableReady) {
+        for (quint32 n = 0; n < 256; ++n) {
+            quint32 c = n;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        tableReady = true;
+    }
+
+    crc = ~crc;
+    const uchar *p = (const uchar*)(data.constData());
+    for (int i = 0; i < data.size(); ++i)
+        crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+// Wraps one chunk into a complete gzip member. Concatenated members form a
+// valid gzip file, so each chunk can be compressed and written on its own.
+static QByteArray gzipMember(const QByteArray &data)
+{
+    // qCompress() emits a 4-byte length, a 2-byte zlib header, the raw
+    // deflate stream and a 4-byte Adler-32 checksum. For no data at all it
+    // emits only the length, so the empty final block is spelled out.
+    QByteArray deflate("\x03\x00", 2);
+    if (!data.isEmpty()) {
+        const QByteArray compressed = qCompress(data);
+        deflate = compressed.mid(6, compressed.size() - 10);
+    }
+
+    QByteArray member;
+    member.reserve(deflate.size() + 18);
+    const char header[] = { 0x1f, char(0x8b), 8, 0, 0, 0, 0, 0, 0, char(0xff) };
+    member.append(header, sizeof(header));
+    member += deflate;
+
+    const quint32 trailer[] = { crc32(data), quint32(data.size()) };
+    for (int t = 0; t < 2; ++t)
+        for (int b = 0; b < 4; ++b)
+            member += char((trailer[t] >> (8 * b)) & 0xff);
+    return member;
+}
+
+bool Phantom::saveContent(const QString &fileName, const QVariantMap &options)
+{
+    QTextCodec *codec = QTextCodec::codecForName("UTF-8");
+    if (options.contains("encoding")) {
+        codec = QTextCodec::codecForName(options.value("encoding").toString().toLatin1());
+        if (!codec)
+            return false;
+    }
+    const bool gzip = options.value("gzip").toBool();
+
+    QFile file(fileName);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate))
+        return false;
+
+    // The document is encoded and written chunk by chunk, so apart from the
+    // serialized frame itself only one chunk is held in memory at a time.
+    const QString html = m_page.mainFrame()->toHtml();
+    const int chunkSize = 256 * 1024;
+    QTextEncoder *encoder = codec->makeEncoder();
+    bool ok = true;
+    for (int pos = 0; ok && pos < html.length(); pos += chunkSize) {
+        const int length = qMin(chunkSize, html.length() - pos);
+        QByteArray chunk = encoder->fromUnicode(html.constData() + pos, length);
+        if (gzip)
+            chunk = gzipMember(chunk);
+        ok = file.write(chunk) == chunk.size();
+    }
+    delete encoder;
+
+    // An empty file is not a gzip file: an empty document still gets one
+    // member, with an empty deflate block.
+    if (ok && gzip && html.isEmpty()) {
+        const QByteArray member = gzipMember(QByteArray());
+        ok = file.write(member) == member.size();
+    }
+
+    file.close();
+    return ok;
 }
 
 void Phantom::setFormInputFile(QWebElement el, const QString &fileTag)
@@ -602,6 +1295,16 @@ QString Phantom::userAgent() const
     return m_page.m_userAgent;
 }
 
+void Phantom::setScriptTimeout(int ms)
+{
+    m_page.m_scriptTimeout = qMax(ms, 0);
+}
+
+int Phantom::scriptTimeout() const
+{
+    return m_page.m_scriptTimeout;
+}
+
 QVariantMap Phantom::version() const
 {
     QVariantMap result;
@@ -675,6 +1378,251 @@ bool Phantom::setCookies(const QVariantList& cookies)
     return m_cookieJar.setCookies(cookies);
 }
 
+void Phantom::setGifPalette(const QVariant &palette)
+{
+    m_gifPaletteSetting = palette;
+    m_gifPalette = GifPalette();
+    m_gifSharedFrames = 0;
+    m_gifSampledFrames = 0;
+    m_gifSamples.clear();
+
+    if (palette.type() == QVariant::List || palette.type() == QVariant::StringList) {
+        QVector<QRgb> colors;
+        foreach (const QVariant &item, palette.toList()) {
+            QColor color(item.toString());
+            if (color.isValid())
+                colors += color.rgb();
+        }
+        m_gifPalette = GifPalette::fromColors(colors);
+        return;
+    }
+
+    const QString name = palette.toString();
+    if (name.isEmpty() || name == "adaptive")
+        return;
+    if (name == "shared" || name.startsWith("shared:")) {
+        m_gifSharedFrames = name == "shared" ? 1 : qMax(1, name.mid(7).toInt());
+        return;
+    }
+    if (name == "websafe") {
+        m_gifPalette = GifPalette::webSafe();
+        return;
+    }
+    // Anything else is the path of an image whose colors form the palette.
+    const QImage image(name);
+    if (image.isNull()) {
+        std::cerr << "Unable to read the GIF palette '" << qPrintable(name) << "', using adaptive palettes" << std::endl;
+        return;
+    }
+    m_gifPalette = GifPalette::fromImage(image);
+}
+
+// A 'shared' or 'shared:N' palette is learned from the first N GIF frames
+// and reused for every GIF after. The frames before the Nth still get an
+// adaptive palette of their own. Each frame is sampled at a fixed width,
+// nearest neighbour so that no new colors appear. Only the visible pixels
+// are kept; transparent ones are written with the transparent index anyway.
+// The palette is made from the pixels of all samples packed into one image.
+void Phantom::learnGifPalette(const QImage &frame)
+{
+    static const int SampleWidth = 512;
+    const QImage sample = frame.scaledToWidth(SampleWidth, Qt::FastTransformation).convertToFormat(QImage::Format_ARGB32);
+    for (int y = 0; y < sample.height(); ++y) {
+        const QRgb *line = reinterpret_cast<const QRgb*>(sample.scanLine(y));
+        for (int x = 0; x < sample.width(); ++x) {
+            if (qAlpha(line[x]) != 0)
+                m_gifSamples += line[x];
+        }
+    }
+    if (++m_gifSampledFrames < m_gifSharedFrames)
+        return;
+
+    // When nothing was visible in them, the next N frames are sampled.
+    m_gifSampledFrames = 0;
+    if (m_gifSamples.isEmpty())
+        return;
+
+    // The last row is filled up with a color already in the samples.
+    const int count = m_gifSamples.count();
+    QImage packed(SampleWidth, (count + SampleWidth - 1) / SampleWidth, QImage::Format_ARGB32);
+    packed.fill(m_gifSamples.first());
+    for (int i = 0; i < count; ++i)
+        reinterpret_cast<QRgb*>(packed.scanLine(i / SampleWidth))[i % SampleWidth] = m_gifSamples.at(i);
+
+    m_gifPalette = GifPalette::fromImage(packed);
+    m_gifSamples.clear();
+}
+
+QVariant Phantom::gifPalette() const
+{
+    return m_gifPaletteSetting;
+}
+
+bool Phantom::addCookie(const QVariantMap &cookie)
+{
+    return m_cookieJar.addCookie(cookie);
+}
+
+bool Phantom::deleteCookie(const QString &name, const QString &domain, const QString &path)
+{
+    return m_cookieJar.deleteCookie(name, domain, path);
+}
+
+QVariantList Phantom::cookiesForUrl(const QString &url) const
+{
+    return m_cookieJar.cookiesForUrlMaps(QUrl(url));
+}
+
+// A session file is a small header followed by a zlib compressed
+// QDataStream with the cookies, in Set-Cookie form, and the Local Storage
+// items of every origin that was loaded, keyed by origin.
+static const quint32 SessionMagic = 0x504a5353; // "PJSS"
+static const quint32 SessionVersion = 1;
+
+static QString originKey(const QWebSecurityOrigin &origin)
+{
+    return QString("%1://%2:%3").arg(origin.scheme(), origin.host()).arg(origin.port());
+}
+
+// Local Storage is only reachable from a document of the same origin, so it
+// is read and written through the frames themselves.
+static const char readStorageScript[] =
+    "(function () {"
+    "    try {"
+    "        var items = {};"
+    "        for (var i = 0; i < localStorage.length; ++i) {"
+    "            var key = localStorage.key(i);"
+    "            items[key] = localStorage.getItem(key);"
+    "        }"
+    "        return items;"
+    "    } catch (e) {"
+    "        return null;"
+    "    }"
+    "})()";
+
+void Phantom::collectStorage(QWebFrame *frame, QMap<QString, QVariantMap> *storage)
+{
+    const QString origin = originKey(frame->securityOrigin());
+    if (!storage->contains(origin)) {
+        const QVariant items = frame->evaluateJavaScript(readStorageScript);
+        if (items.type() == QVariant::Map && !items.toMap().isEmpty())
+            storage->insert(origin, items.toMap());
+    }
+    foreach (QWebFrame *child, frame->childFrames())
+        collectStorage(child, storage);
+}
+
+bool Phantom::saveSession(const QString &fileName)
+{
+    QList<QByteArray> cookies;
+    foreach (const QNetworkCookie &cookie, m_cookieJar.storedCookies())
+        cookies += cookie.toRawForm(QNetworkCookie::Full);
+
+    // Origins restored from a session but not visited since are carried
+    // over unchanged.
+    QMap<QString, QVariantMap> storage;
+    collectStorage(m_page.mainFrame(), &storage);
+    QMap<QString, QVariantMap>::const_iterator it;
+    for (it = m_pendingStorage.constBegin(); it != m_pendingStorage.constEnd(); ++it) {
+        if (!storage.contains(it.key()))
+            storage.insert(it.key(), it.value());
+    }
+
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_4_5);
+    stream << cookies << storage;
+
+    QByteArray data;
+    QDataStream header(&data, QIODevice::WriteOnly);
+    header << SessionMagic << SessionVersion;
+    data += qCompress(payload);
+
+    // Written aside and renamed, so that a worker starting meanwhile never
+    // reads half a session. The temporary name is unique, so concurrent
+    // saves do not write into each other's file.
+    QTemporaryFile temp(fileName + ".XXXXXX");
+    if (!temp.open() || temp.write(data) != data.size())
+        return false;
+    temp.close();
+#ifdef Q_OS_UNIX
+    return ::rename(QFile::encodeName(temp.fileName()).constData(), QFile::encodeName(fileName).constData()) == 0;
+#else
+    QFile::remove(fileName);
+    return QFile::rename(temp.fileName(), fileName);
+#endif
+}
+
+bool Phantom::loadSession(const QString &fileName, bool storageEnabled)
+{
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly))
+        return false;
+    const QByteArray data = file.readAll();
+    file.close();
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    QDataStream header(data);
+    header >> magic >> version;
+    if (magic != SessionMagic || version != SessionVersion)
+        return false;
+
+    const QByteArray payload = qUncompress(data.mid(2 * sizeof(quint32)));
+    if (payload.isEmpty())
+        return false;
+
+    QList<QByteArray> rawCookies;
+    QMap<QString, QVariantMap> storage;
+    QDataStream stream(payload);
+    stream.setVersion(QDataStream::Qt_4_5);
+    stream >> rawCookies >> storage;
+    if (stream.status() != QDataStream::Ok)
+        return false;
+
+    QList<QNetworkCookie> cookies;
+    foreach (const QByteArray &raw, rawCookies)
+        cookies += QNetworkCookie::parseCookies(raw);
+    m_cookieJar.mergeCookies(cookies);
+
+    // The items are written into Local Storage by the first document of
+    // each origin, before any of its scripts run.
+    if (storageEnabled)
+        m_pendingStorage = storage;
+    else if (!storage.isEmpty())
+        std::cerr << "Local Storage is disabled, only cookies are restored from the session" << std::endl;
+    return true;
+}
+
+void Phantom::watchFrame(QWebFrame *frame)
+{
+    connect(frame, SIGNAL(javaScriptWindowObjectCleared()), SLOT(restoreStorage()));
+}
+
+void Phantom::restoreStorage()
+{
+    QWebFrame *frame = qobject_cast<QWebFrame*>(sender());
+    if (!frame || m_pendingStorage.isEmpty())
+        return;
+
+    const QString origin = originKey(frame->securityOrigin());
+    if (!m_pendingStorage.contains(origin))
+        return;
+
+    QByteArray items;
+    appendJson(items, m_pendingStorage.take(origin));
+    // JSON allows the line and paragraph separators in strings, JavaScript
+    // source does not.
+    items.replace("\xe2\x80\xa8", "\\u2028");
+    items.replace("\xe2\x80\xa9", "\\u2029");
+    frame->evaluateJavaScript(QString("(function (items) {"
+                                      "    try {"
+                                      "        for (var key in items)"
+                                      "            localStorage.setItem(key, items[key]);"
+                                      "    } catch (e) {}"
+                                      "})(%1)").arg(QString::fromUtf8(items)));
+}
+
 static qreal stringToPointSize(const QString &string)
 {
     static const struct {
@@ -753,6 +1701,33 @@ bool Phantom::renderPdf(const QString &fileName)
 
 #include "phantomjs.moc"
 
+// Ahead-of-time mode: phantomjs --compile script.coffee script.js
+static int compileScript(const QString &input, const QString &output)
+{
+    QFile file(input);
+    if (!file.open(QFile::ReadOnly)) {
+        std::cerr << "Can't open " << qPrintable(input) << std::endl;
+        return 1;
+    }
+    const QString source = QString::fromUtf8(file.readAll());
+    file.close();
+
+    const QString script = CSConverter::instance()->convert(source);
+    if (script.isEmpty()) {
+        std::cerr << "Unable to compile " << qPrintable(input) << std::endl;
+        return 1;
+    }
+
+    QFile result(output);
+    if (!result.open(QFile::WriteOnly | QFile::Truncate)) {
+        std::cerr << "Can't write " << qPrintable(output) << std::endl;
+        return 1;
+    }
+    result.write(script.toUtf8());
+    result.close();
+    return 0;
+}
+
 int main(int argc, char** argv)
 {
     if (argc < 2) {
@@ -760,14 +1735,35 @@ int main(int argc, char** argv)
         return 1;
     }
 
+    for (int i = 1; i < argc; ++i) {
+        if (qstrcmp(argv[i], "--startup-trace") == 0) {
+            startupTraceEnabled = true;
+            startupTimer.start();
+        }
+    }
+
     QApplication app(argc, argv);
 
-    app.setWindowIcon(QIcon(":/phantomjs-icon.png"));
+    // Given its size, the icon is only read if a window ever asks for it.
+    QIcon icon;
+    icon.addFile(":/phantomjs-icon.png", QSize(256, 256));
+    app.setWindowIcon(icon);
+
     app.setApplicationName("PhantomJS");
     app.setOrganizationName("Ofi Labs");
     app.setOrganizationDomain("www.ofilabs.com");
     app.setApplicationVersion(PHANTOMJS_VERSION_STRING);
 
+    startupTrace("application");
+
+    if (QString(argv[1]) == "--compile") {
+        if (argc != 4) {
+            showUsage();
+            return 1;
+        }
+        return compileScript(QString::fromLocal8Bit(argv[2]), QString::fromLocal8Bit(argv[3]));
+    }
+
     Phantom phantom;
     if (phantom.execute()) {
         app.exec();
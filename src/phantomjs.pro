@@ -1,10 +1,10 @@
 TEMPLATE = app
 TARGET = phantomjs
 DESTDIR = ../bin
-HEADERS += csconverter.h
-SOURCES = phantomjs.cpp csconverter.cpp
+HEADERS += csconverter.h consolewriter.h cookiejar.h domfingerprint.h hostresolver.h imagediff.h jsonwriter.h networkaccessmanager.h networkarchive.h networkthrottle.h outputstream.h proxyreply.h renderbufferpool.h rendercache.h
+SOURCES = phantomjs.cpp csconverter.cpp consolewriter.cpp cookiejar.cpp domfingerprint.cpp hostresolver.cpp imagediff.cpp jsonwriter.cpp networkaccessmanager.cpp networkarchive.cpp networkthrottle.cpp outputstream.cpp proxyreply.cpp renderbufferpool.cpp rendercache.cpp
 RESOURCES = phantomjs.qrc
-QT += network webkit
+QT += network script webkit
 CONFIG += console
 
 include(gif/gif.pri)
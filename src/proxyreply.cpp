@@ -0,0 +1,156 @@
+/*
+  This file is part of the PhantomJS project from Ofi Labs.
+
+  Copyright (C) 2011 Ariya Hidayat <ariya.hidayat@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "proxyreply.h"
+
+ProxyReply::ProxyReply(QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent)
+    : QNetworkReply(parent)
+    , m_reply(0)
+    , m_done(false)
+{
+    setRequest(request);
+    setOperation(op);
+    setUrl(request.url());
+    open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+}
+
+void ProxyReply::attach(QNetworkReply *reply)
+{
+    m_reply = reply;
+    m_reply->setParent(this);
+    if (readBufferSize())
+        m_reply->setReadBufferSize(readBufferSize());
+
+    connect(m_reply, SIGNAL(metaDataChanged()), SLOT(forwardMetaData()));
+    connect(m_reply, SIGNAL(readyRead()), SLOT(forwardReadyRead()));
+    connect(m_reply, SIGNAL(downloadProgress(qint64, qint64)), SLOT(forwardDownloadProgress(qint64, qint64)));
+    connect(m_reply, SIGNAL(uploadProgress(qint64, qint64)), SIGNAL(uploadProgress(qint64, qint64)));
+    connect(m_reply, SIGNAL(error(QNetworkReply::NetworkError)), SLOT(forwardError(QNetworkReply::NetworkError)));
+    connect(m_reply, SIGNAL(finished()), SLOT(forwardFinished()));
+}
+
+// Ends a reply that never got an inner one.
+void ProxyReply::fail(QNetworkReply::NetworkError code, const QString &message)
+{
+    if (m_done)
+        return;
+    setError(code, message);
+    emit error(code);
+    finish();
+}
+
+void ProxyReply::abort()
+{
+    if (m_reply)
+        m_reply->abort();
+    else
+        fail(OperationCanceledError, "Operation canceled");
+}
+
+qint64 ProxyReply::bytesAvailable() const
+{
+    return (m_reply ? m_reply->bytesAvailable() : 0) + QNetworkReply::bytesAvailable();
+}
+
+bool ProxyReply::isSequential() const
+{
+    return true;
+}
+
+void ProxyReply::setReadBufferSize(qint64 size)
+{
+    QNetworkReply::setReadBufferSize(size);
+    if (m_reply)
+        m_reply->setReadBufferSize(size);
+}
+
+void ProxyReply::ignoreSslErrors()
+{
+    if (m_reply)
+        m_reply->ignoreSslErrors();
+}
+
+QNetworkReply *ProxyReply::innerReply() const
+{
+    return m_reply;
+}
+
+bool ProxyReply::isDone() const
+{
+    return m_done;
+}
+
+void ProxyReply::finish()
+{
+    m_done = true;
+#if QT_VERSION >= QT_VERSION_CHECK(4, 7, 0)
+    setFinished(true);
+#endif
+    emit readChannelFinished();
+    emit finished();
+}
+
+qint64 ProxyReply::readData(char *data, qint64 maxSize)
+{
+    if (!m_reply)
+        return 0;
+    return m_reply->read(data, maxSize);
+}
+
+void ProxyReply::forwardMetaData()
+{
+    foreach (const QByteArray &name, m_reply->rawHeaderList())
+        setRawHeader(name, m_reply->rawHeader(name));
+    setAttribute(QNetworkRequest::HttpStatusCodeAttribute, m_reply->attribute(QNetworkRequest::HttpStatusCodeAttribute));
+    setAttribute(QNetworkRequest::HttpReasonPhraseAttribute, m_reply->attribute(QNetworkRequest::HttpReasonPhraseAttribute));
+    setAttribute(QNetworkRequest::RedirectionTargetAttribute, m_reply->attribute(QNetworkRequest::RedirectionTargetAttribute));
+    setAttribute(QNetworkRequest::SourceIsFromCacheAttribute, m_reply->attribute(QNetworkRequest::SourceIsFromCacheAttribute));
+    emit metaDataChanged();
+}
+
+void ProxyReply::forwardReadyRead()
+{
+    emit readyRead();
+}
+
+void ProxyReply::forwardDownloadProgress(qint64 received, qint64 total)
+{
+    emit downloadProgress(received, total);
+}
+
+void ProxyReply::forwardError(QNetworkReply::NetworkError code)
+{
+    setError(code, m_reply->errorString());
+    emit error(code);
+}
+
+void ProxyReply::forwardFinished()
+{
+    finish();
+}
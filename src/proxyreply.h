@@ -0,0 +1,76 @@
+/*
+  This file is part of the PhantomJS project from Ofi Labs.
+
+  Copyright (C) 2011 Ariya Hidayat <ariya.hidayat@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef PROXYREPLY_H
+#define PROXYREPLY_H
+
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+
+// Passes another reply through to the page: its headers, data, progress,
+// errors and end. The inner reply may be attached after the proxy was
+// handed out, e.g. once the host it goes to is known.
+class ProxyReply: public QNetworkReply
+{
+    Q_OBJECT
+
+public:
+    ProxyReply(QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent = 0);
+
+    void attach(QNetworkReply *reply);
+    void fail(QNetworkReply::NetworkError code, const QString &message);
+
+    void abort();
+    qint64 bytesAvailable() const;
+    bool isSequential() const;
+    void setReadBufferSize(qint64 size);
+
+public slots:
+    void ignoreSslErrors();
+
+protected:
+    QNetworkReply *innerReply() const;
+    bool isDone() const;
+    void finish();
+
+    qint64 readData(char *data, qint64 maxSize);
+
+protected slots:
+    virtual void forwardMetaData();
+    virtual void forwardReadyRead();
+    virtual void forwardDownloadProgress(qint64 received, qint64 total);
+    virtual void forwardError(QNetworkReply::NetworkError code);
+    virtual void forwardFinished();
+
+private:
+    QNetworkReply *m_reply;
+    bool m_done;
+};
+
+#endif // PROXYREPLY_H
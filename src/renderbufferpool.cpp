@@ -0,0 +1,167 @@
+/*
+  This file is part of the PhantomJS project from Ofi Labs.
+
+  Copyright (C) 2011 Ariya Hidayat <ariya.hidayat@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "renderbufferpool.h"
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#endif
+
+// Free buffers kept for later renders.
+static const int MaxFreeBuffers = 2;
+
+// Buffers from this size on are mapped directly, which gives page-aligned
+// memory that is already zero, and may be backed by huge pages.
+static const qint64 MappedBufferSize = 4 * 1024 * 1024;
+
+RenderBufferPool::RenderBufferPool()
+    : m_requests(0)
+    , m_hits(0)
+    , m_bytesReused(0)
+{
+}
+
+RenderBufferPool::~RenderBufferPool()
+{
+    foreach (const Buffer &buffer, m_buffers)
+        deallocate(buffer);
+}
+
+// A free buffer is reused when it is large enough but not more than twice
+// the size needed, so that one very large buffer does not stay pinned for
+// all the small renders that follow. Only the part that is handed out is
+// cleared.
+QImage RenderBufferPool::acquire(const QSize &size, QImage::Format format, uint fill)
+{
+    const int bytesPerLine = size.width() * 4;
+    const qint64 bytes = qint64(bytesPerLine) * size.height();
+    ++m_requests;
+
+    int best = -1;
+    for (int i = 0; i < m_buffers.count(); ++i) {
+        const Buffer &buffer = m_buffers.at(i);
+        if (buffer.inUse || buffer.capacity < bytes || buffer.capacity / 2 > bytes)
+            continue;
+        if (best < 0 || buffer.capacity < m_buffers.at(best).capacity)
+            best = i;
+    }
+
+    if (best >= 0) {
+        ++m_hits;
+        m_bytesReused += bytes;
+    } else {
+        const Buffer buffer = allocate(bytes);
+        if (!buffer.data) {
+            QImage image(size, format);
+            image.fill(fill);
+            return image;
+        }
+        m_buffers += buffer;
+        best = m_buffers.count() - 1;
+    }
+
+    Buffer &buffer = m_buffers[best];
+    buffer.inUse = true;
+    QImage image(buffer.data, size.width(), size.height(), bytesPerLine, format);
+    // Freshly mapped memory is zero already, which is what a transparent
+    // premultiplied render starts from.
+    if (!buffer.zeroed || fill != 0)
+        image.fill(fill);
+    buffer.zeroed = false;
+    return image;
+}
+
+void RenderBufferPool::release(const QImage &image)
+{
+    int freeCount = 0;
+    for (int i = 0; i < m_buffers.count(); ++i) {
+        if (m_buffers.at(i).data == image.bits())
+            m_buffers[i].inUse = false;
+        if (!m_buffers.at(i).inUse)
+            ++freeCount;
+    }
+
+    // Drop the oldest free buffers beyond the limit.
+    for (int i = 0; i < m_buffers.count() && freeCount > MaxFreeBuffers; ) {
+        if (m_buffers.at(i).inUse) {
+            ++i;
+            continue;
+        }
+        deallocate(m_buffers.takeAt(i));
+        --freeCount;
+    }
+}
+
+QVariantMap RenderBufferPool::stats() const
+{
+    QVariantMap result;
+    result["requests"] = m_requests;
+    result["hits"] = m_hits;
+    result["hitRate"] = m_requests > 0 ? double(m_hits) / m_requests : 0.0;
+    result["bytesReused"] = m_bytesReused;
+    return result;
+}
+
+RenderBufferPool::Buffer RenderBufferPool::allocate(qint64 bytes)
+{
+    Buffer buffer;
+    buffer.capacity = bytes;
+    buffer.inUse = false;
+
+#ifdef Q_OS_UNIX
+    if (bytes >= MappedBufferSize) {
+        void *data = mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+        if (data != MAP_FAILED) {
+#ifdef MADV_HUGEPAGE
+            madvise(data, bytes, MADV_HUGEPAGE);
+#endif
+            buffer.data = static_cast<uchar*>(data);
+            buffer.mapped = true;
+            buffer.zeroed = true;
+            return buffer;
+        }
+    }
+#endif
+
+    buffer.data = static_cast<uchar*>(qMalloc(bytes));
+    buffer.mapped = false;
+    buffer.zeroed = false;
+    return buffer;
+}
+
+void RenderBufferPool::deallocate(const Buffer &buffer)
+{
+#ifdef Q_OS_UNIX
+    if (buffer.mapped) {
+        munmap(buffer.data, buffer.capacity);
+        return;
+    }
+#endif
+    qFree(buffer.data);
+}
@@ -0,0 +1,72 @@
+/*
+  This file is part of the PhantomJS project from Ofi Labs.
+
+  Copyright (C) 2011 Ariya Hidayat <ariya.hidayat@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef RENDERBUFFERPOOL_H
+#define RENDERBUFFERPOOL_H
+
+#include <QImage>
+#include <QList>
+#include <QVariantMap>
+
+// Pixel buffers for render(), kept between calls so that rendering the same
+// size over and over does not allocate, fault in and clear a fresh
+// multi-megabyte image every time.
+//
+// The images handed out do not own their pixels: every image acquired must
+// be released, and must not be used after that.
+class RenderBufferPool
+{
+public:
+    RenderBufferPool();
+    ~RenderBufferPool();
+
+    QImage acquire(const QSize &size, QImage::Format format, uint fill);
+    void release(const QImage &image);
+
+    QVariantMap stats() const;
+
+private:
+    struct Buffer {
+        uchar *data;
+        qint64 capacity;
+        bool mapped;
+        bool zeroed;
+        bool inUse;
+    };
+
+    Buffer allocate(qint64 bytes);
+    void deallocate(const Buffer &buffer);
+
+    QList<Buffer> m_buffers;
+    int m_requests;
+    int m_hits;
+    qint64 m_bytesReused;
+};
+
+#endif // RENDERBUFFERPOOL_H
@@ -0,0 +1,114 @@
+/*
+  This file is part of the PhantomJS project from Ofi Labs.
+
+  Copyright (C) 2011 Ariya Hidayat <ariya.hidayat@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "rendercache.h"
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+
+#include <stdio.h>
+
+// An entry is the validator on its own line followed by the encoded image,
+// so both are replaced together.
+
+void RenderCache::setDirectory(const QString &path)
+{
+    m_directory = path;
+}
+
+bool RenderCache::isEnabled() const
+{
+    return !m_directory.isEmpty();
+}
+
+QByteArray RenderCache::key(const QUrl &url, const QSize &viewportSize, const QRect &clipRect,
+                            const QString &format, const QByteArray &options)
+{
+    QByteArray data = url.toEncoded();
+    data += '\n' + QByteArray::number(viewportSize.width()) + 'x' + QByteArray::number(viewportSize.height());
+    data += '\n' + QByteArray::number(clipRect.x()) + ',' + QByteArray::number(clipRect.y())
+            + ',' + QByteArray::number(clipRect.width()) + 'x' + QByteArray::number(clipRect.height());
+    data += '\n' + format.toLower().toLatin1();
+    data += '\n' + options;
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha1).toHex();
+}
+
+QString RenderCache::entryName(const QByteArray &key) const
+{
+    return m_directory + "/" + QString::fromLatin1(key) + ".render";
+}
+
+bool RenderCache::fetch(const QByteArray &key, const QByteArray &validator, const QString &fileName) const
+{
+    QFile entry(entryName(key));
+    if (!entry.open(QFile::ReadOnly))
+        return false;
+    if (entry.readLine().trimmed() != validator)
+        return false;
+    const QByteArray image = entry.readAll();
+    entry.close();
+
+    QFile output(fileName);
+    if (!output.open(QFile::WriteOnly | QFile::Truncate))
+        return false;
+    return output.write(image) == image.size();
+}
+
+void RenderCache::store(const QByteArray &key, const QByteArray &validator, const QString &fileName) const
+{
+    QFile rendered(fileName);
+    if (!rendered.open(QFile::ReadOnly))
+        return;
+    const QByteArray image = rendered.readAll();
+    rendered.close();
+
+    // Write aside and rename, so that a concurrent run never reads a
+    // partially written entry.
+    QDir().mkpath(m_directory);
+    const QString name = entryName(key);
+    const QString tempName = name + QString(".%1.tmp").arg(QCoreApplication::applicationPid());
+    QFile temp(tempName);
+    if (!temp.open(QFile::WriteOnly | QFile::Truncate))
+        return;
+    const bool written = temp.write(validator + '\n') == validator.size() + 1 && temp.write(image) == image.size();
+    temp.close();
+    if (!written) {
+        temp.remove();
+        return;
+    }
+#ifdef Q_OS_UNIX
+    ::rename(QFile::encodeName(tempName).constData(), QFile::encodeName(name).constData());
+#else
+    QFile::remove(name);
+    if (!QFile::rename(tempName, name))
+        QFile::remove(tempName);
+#endif
+}
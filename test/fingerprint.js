@@ -0,0 +1,45 @@
+// Checks phantom.fingerprint() on the page the script runs in.
+// Usage: phantomjs test/fingerprint.js (exits with 1 on a failure)
+
+var failures = 0;
+
+function fingerprint() {
+    return phantom.fingerprint({ selector: 'body', ignore: ['time', '.ad'] });
+}
+
+function check(name, html, change, expectChanged) {
+    document.body.innerHTML = html;
+    var before = fingerprint();
+    change();
+    var changed = fingerprint() !== before;
+    if (changed !== expectChanged) {
+        console.log('FAIL ' + name);
+        ++failures;
+    } else {
+        console.log('PASS ' + name);
+    }
+}
+
+check('text next to an ignored element', '<p id="p">Price: 5 <time>now</time></p>', function () {
+    document.getElementById('p').firstChild.data = 'Price: 6 ';
+}, true);
+
+check('ignored element', '<p>Price: 5 <time id="t">now</time></p>', function () {
+    document.getElementById('t').textContent = 'later';
+}, false);
+
+check('text after an ignored element', '<div id="d"><span class="ad">buy</span> news</div>', function () {
+    document.getElementById('d').lastChild.data = ' old news';
+}, true);
+
+check('nested ignored element', '<div><p>a <span class="ad">b <time id="t">c</time></span></p></div>', function () {
+    document.getElementById('t').textContent = 'd';
+}, false);
+
+check('no markers left in the page', '<p>a <time>b</time></p>', function () {
+    fingerprint();
+    if (document.body.innerHTML !== '<p>a <time>b</time></p>')
+        document.body.appendChild(document.createElement('hr'));
+}, false);
+
+phantom.exit(failures ? 1 : 0);